@@ -2,6 +2,7 @@
 #include <algorithm>
 #include <array>
 #include <vector>
+#include <string>
 #include "Shared/Shared.h"
 #include "Shared/CKeySet.h"
 
@@ -31,19 +32,35 @@ bool TestResults (const std::vector<TINT> &superPositionedBits, const std::vecto
 //=================================================================================
 int main (int argc, char **argv)
 {
-    // get and verify parameters
-    size_t numBits, minKey;
+    // get and verify parameters.  They are parsed as unsigned long long since VS2013
+    // doesn't support %zu.
+    unsigned long long numBits, minKey;
     std::cout << "--KeyGenerator--\n\nGenerates superpositioned bit values and keys for use in superpositional\ncomputation using HE over the integers.\n\n";
-    if (argc < 4 || sscanf(argv[1], "%i", &numBits) != 1 || sscanf(argv[2], "%i", &minKey) != 1)
+    unsigned long long numThreads = 0, memoryLimitMB = 0;
+    if (argc < 4 || sscanf(argv[1], "%llu", &numBits) != 1 || sscanf(argv[2], "%llu", &minKey) != 1 ||
+        (argc > 4 && sscanf(argv[4], "%llu", &numThreads) != 1) ||
+        (argc > 5 && sscanf(argv[5], "%llu", &memoryLimitMB) != 1))
     {
-        std::cout << "Usage: <numBits> <minKey> <outputFile>\n";;
+        std::cout << "Usage: <numBits> <minKey> <outputFile> [numThreads] [memoryLimitMB]\n";
+        std::cout << "  outputFile is written in the binary format if it ends in .bin.\n";
+        std::cout << "  numThreads defaults to one per hardware thread.  memoryLimitMB defaults to no limit.\n";
         ExitCode_(1);
     }
 
     // calculate superpositioned bits and keys
     std::cout << "Calculating values for " << numBits << " bits.\n";
     CKeySet keySet;
-    keySet.Calculate(numBits, minKey);
+    keySet.SetNumThreads(size_t(numThreads));
+    keySet.SetMemoryLimit(size_t(memoryLimitMB * 1024 * 1024));
+    uint8_t lastPercent = 0;
+    keySet.Calculate(int(numBits), TINT(minKey),
+        [&lastPercent] (uint8_t percent)
+        {
+            if (percent / 10 != lastPercent / 10)
+                std::cout << int(percent) << "%\n";
+            lastPercent = percent;
+        }
+    );
 
     // Verify results
     std::cout << "Done.\n\nVerifying results...\n";
@@ -54,8 +71,10 @@ int main (int argc, char **argv)
     }
     std::cout << "Done.\n";
 
-    // Write results
-    if (!keySet.Write(argv[3]))
+    // Write results.  Output files ending in .bin use the binary format.
+    const std::string outputFile = argv[3];
+    const bool binary = outputFile.size() >= 4 && outputFile.compare(outputFile.size() - 4, 4, ".bin") == 0;
+    if (!(binary ? keySet.WriteBinary(argv[3]) : keySet.Write(argv[3])))
     {
         std::cout << "\nCould not write results to " << argv[3] << "\n";
         ExitCode_(1);
@@ -79,10 +79,14 @@ TODO:
 
 * try GMP backend for boost numbers and tom_int (http://www.boost.org/doc/libs/1_56_0/libs/multiprecision/doc/html/index.html)
  * see if those guys are any faster than cpp_int
+ ! TINT_BACKEND in TINT.h selects them.  DO_BACKEND_REPORT() in SimpleCode makes a table comparing them.
+ ! gmp is faster once keys get large (3 bit division and modulus), cpp_int is faster for small keys.
  * see if there's still a problem with dividing 1.5 by -0.5 in CSuperFixed<3,2> with increased division precision
 
 * try doing fixed size integers to get rid of allocations.
  * could look into something that makes operations reflective and outputs a cpp file that is the flat operations done with the right number of bits in each step.
+ ! CCircuit records the gates (see CKeySet::SetRecorder()), and can write them to a file and replay them.
+ ! CCircuit::WriteCpp() outputs the cpp file, with fixed width integers sized for each step.
 
 * it's easy to bust the size of fixed point by accident. how should we deal with that? like a <2,2> when you add 1.5 and 0.5 you got -2.0, which is wrong.
 
@@ -101,6 +105,7 @@ TODO:
  * dunno...
 * profile code eventually and figure out where the time is going, and try to optimize
  * might want -= and += operators? maybe ++ and -- too? less memory copying
+  ! CSuperInt and CSuperFixed have +=, -=, *=, /= (and ++, -- for CSuperInt), and + and - use them.
 
 
 * refer to TINT as SuperBit? or typedef it as the same so you can use whichever is more appropriate situationally? phantom type it?
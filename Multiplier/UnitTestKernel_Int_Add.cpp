@@ -0,0 +1,55 @@
+//=================================================================================
+//
+//  UnitTestKernel_Int_Add
+//
+//  Generated by CCircuit::WriteCpp().  4 XOR gates, 3 AND gates, 7 reductions, 140 bits at most.
+//
+//  inputs are 4 superpositional bits less than the keys LCM, which has 70 bits.
+//  lcm is the LCM and reciprocal is its Barrett reciprocal, floor(2^140 / lcm).  outputs
+//  are the same mod the LCM as what the recorded math gives.
+//
+//=================================================================================
+
+#include <stdint.h>
+#include <boost/multiprecision/cpp_int.hpp>
+
+typedef boost::multiprecision::number<boost::multiprecision::cpp_int_backend<128, 128, boost::multiprecision::unsigned_magnitude, boost::multiprecision::unchecked, void>> TUInt128;
+typedef boost::multiprecision::number<boost::multiprecision::cpp_int_backend<192, 192, boost::multiprecision::unsigned_magnitude, boost::multiprecision::unchecked, void>> TUInt192;
+typedef TUInt128 TInput;
+typedef TUInt128 TOutput;
+typedef TUInt192 TReduce;
+
+//=================================================================================
+static TReduce UnitTestKernel_Int_Add_Reduce (TReduce v, const TReduce &lcm, const TReduce &reciprocal)
+{
+    v.backend().normalize();
+    TReduce q = v >> 69;
+    q *= reciprocal;
+    q.backend().normalize();
+    q >>= 71;
+    q *= lcm;
+    q.backend().normalize();
+    v -= q;
+    while (v >= lcm)
+        v -= lcm;
+    return v;
+}
+
+//=================================================================================
+void UnitTestKernel_Int_Add (const TInput inputs[4], TOutput outputs[2], const TReduce &lcm, const TReduce &reciprocal)
+{
+    TUInt128 v128_0;
+    TUInt128 v128_1;
+    TUInt128 v128_2;
+    TUInt128 v128_3;
+
+    v128_0 = TUInt128(UnitTestKernel_Int_Add_Reduce(TUInt192(TUInt128(inputs[0]) + TUInt128(inputs[2])), lcm, reciprocal));  // 6 XOR, 70 bits
+    outputs[0] = TOutput(v128_0);
+    v128_0 = TUInt128(UnitTestKernel_Int_Add_Reduce(TUInt192(TUInt192(inputs[0]) * TUInt192(inputs[2])), lcm, reciprocal));  // 7 AND, 70 bits
+    v128_1 = TUInt128(UnitTestKernel_Int_Add_Reduce(TUInt192(TUInt128(inputs[1]) + TUInt128(inputs[3])), lcm, reciprocal));  // 8 XOR, 70 bits
+    v128_2 = TUInt128(UnitTestKernel_Int_Add_Reduce(TUInt192(TUInt192(v128_0) * TUInt192(v128_1)), lcm, reciprocal));  // 9 AND, 70 bits
+    v128_3 = TUInt128(UnitTestKernel_Int_Add_Reduce(TUInt192(TUInt192(inputs[1]) * TUInt192(inputs[3])), lcm, reciprocal));  // 10 AND, 70 bits
+    v128_2 = TUInt128(UnitTestKernel_Int_Add_Reduce(TUInt192(TUInt128(v128_3) + TUInt128(v128_2)), lcm, reciprocal));  // 11 XOR, 70 bits
+    v128_0 = TUInt128(UnitTestKernel_Int_Add_Reduce(TUInt192(TUInt128(v128_1) + TUInt128(v128_0)), lcm, reciprocal));  // 12 XOR, 70 bits
+    outputs[1] = TOutput(v128_0);
+}
@@ -13,6 +13,10 @@ UNITTEST(Name, BasicType, SuperType, Operation, AllowRightSideZero)
 */
 
 typedef CSuperInt<3> TSuperInt;
+typedef CSuperInt<3, CRNSBit> TSuperIntRNS;
+typedef CSuperInt<1> TSuperIntTiny;
+typedef CSuperInt<2> TSuperIntSmall;
+typedef CSuperInt<2, CRNSBit> TSuperIntSmallRNS;
 typedef CSuperFixed<2, 2> TSuperFixed;
 typedef CFixed<2, 2> TFixed;
 
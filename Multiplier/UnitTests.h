@@ -10,6 +10,10 @@
 
 #include "Shared\CSuperFixed.h"
 #include "Shared\CFixed.h"
+#include "Shared\CFixedWidthBit.h"
+#include "Shared\CCircuit.h"
+#include <fstream>
+#include <iterator>
 
 // TODO: convert unit test code to use SuperType and BasicType all the way.
 // TODO: make it show fixed point as float output
@@ -40,27 +44,54 @@
     }
 #include "UnitTestList.h"
 
+// make a type for each operation, so the operation can be done on a type chosen at runtime
+#define UNITTEST(Name, BasicType, SuperType, Operation, AllowRightSideZero) \
+    struct SUnitTestFunction_##Name \
+    { \
+        template <typename T> \
+        static T Do (T& a, T& b) { return UnitTestFunction_##Name(a, b); } \
+    };
+#include "UnitTestList.h"
+
+// The smallest key an operation on two SuperTypes needs, from doing it on the largest values
+template <typename SuperType, typename TFUNCTION>
+TINT FindUnitTestMinKey ()
+{
+    std::shared_ptr<CKeySet> exploreKeys = std::make_shared<CKeySet>();
+    SuperType exploreA(exploreKeys);
+    SuperType exploreB(exploreKeys);
+    exploreA.SetToBinaryMax();
+    exploreB.SetToBinaryMax();
+    SuperType exploreResult = TFUNCTION::Do(exploreA, exploreB);
+    return (*std::max_element(exploreResult.GetBits().begin(), exploreResult.GetBits().end()));
+}
+
+// Makes the key set for doing an operation on two SuperTypes.  A and B get the first and
+// second half of the superpositioned bits.
+template <typename SuperType, typename TFUNCTION>
+std::shared_ptr<CKeySet> MakeUnitTestKeys (
+    std::vector<TINT>::const_iterator &bitsA,
+    std::vector<TINT>::const_iterator &bitsB,
+    const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t) {}
+)
+{
+    const TINT minKey = FindUnitTestMinKey<SuperType, TFUNCTION>();
+    std::shared_ptr<CKeySet> keySet = std::make_shared<CKeySet>();
+    keySet->CalculateCached(SuperType::c_numBits * 2, minKey, progressCallback);
+    bitsA = keySet->GetSuperPositionedBits().begin();
+    bitsB = bitsA + SuperType::c_numBits;
+    return keySet;
+}
+
 // make the actual unit test
 #define UNITTEST(Name, BasicType, SuperType, Operation, AllowRightSideZero) \
     bool DoUnitTest_##Name () \
     { \
         printf("UnitTest: " #Name "\n"); \
-        /* Figure out the smallest key we'll need for this operation */ \
-        TINT minKey = 0; \
-        { \
-            std::shared_ptr<CKeySet> exploreKeys = std::make_shared<CKeySet>(); \
-            SuperType exploreA(exploreKeys); \
-            SuperType exploreB(exploreKeys); \
-            exploreA.SetToBinaryMax(); \
-            exploreB.SetToBinaryMax(); \
-            SuperType exploreResult = UnitTestFunction_##Name(exploreA, exploreB); \
-            minKey = (*std::max_element(exploreResult.GetBits().begin(), exploreResult.GetBits().end())); \
-        } \
-        \
         /* make the key set that we need, reporting progress */ \
         printf("Making Keys: "); \
-        std::shared_ptr<CKeySet> keySet = std::make_shared<CKeySet>(); \
-        keySet->CalculateCached(SuperType::c_numBits * 2, minKey, \
+        std::vector<TINT>::const_iterator bitsA, bitsB; \
+        std::shared_ptr<CKeySet> keySet = MakeUnitTestKeys<SuperType, SUnitTestFunction_##Name>(bitsA, bitsB, \
             [] (uint8_t percent) \
             { \
                 static uint8_t lastPercent = 0; \
@@ -76,10 +107,13 @@
         \
         /* Do our superpositional math */ \
         std::cout << "a" << " " #Operation " " << "b in " << SuperType::c_numBits << " bits\n"; \
-        SuperType A(keySet->GetSuperPositionedBits().begin(), keySet); \
-        SuperType B(keySet->GetSuperPositionedBits().begin() + keySet->GetSuperPositionedBits().size() / 2, keySet); \
+        SuperType A(bitsA, keySet); \
+        SuperType B(bitsB, keySet); \
         SuperType resultsAB(keySet); \
+        CTINTArena::ResetPeakSlabBytes(); \
+        const size_t c_allocationsBefore = CTINTArena::GetNumAllocations(); \
         resultsAB = UnitTestFunction_##Name(A,B); \
+        printf("Peak arena size: %u KB, TINT allocations: %u\n", unsigned(CTINTArena::GetPeakSlabBytes() / 1024), unsigned(CTINTArena::GetNumAllocations() - c_allocationsBefore)); \
         /* show superpositional result and error (max and % of each key) */ \
         BITSANDERROR(ReportBitsAndError(resultsAB)); \
         \
@@ -113,6 +147,365 @@
     }
 #include "UnitTestList.h"
 
+// Verify that residue number system bit storage gives the same results as TINT storage
+template <typename SuperType, typename SuperTypeRNS, typename TFUNCTION>
+bool DoUnitTestRNS (const char *name)
+{
+    printf("UnitTest: %s_RNS\n", name);
+
+    std::vector<TINT>::const_iterator bitsA, bitsB;
+    std::shared_ptr<CKeySet> keySet = MakeUnitTestKeys<SuperType, TFUNCTION>(bitsA, bitsB);
+    if (!CRNSBit::CanStore(*keySet))
+    {
+        std::cout << "ERROR! keys are too large for RNS storage!\n";
+        return false;
+    }
+    printf("%u bits, largest key is %u bits\n", unsigned(SuperType::c_numBits), unsigned(boost::multiprecision::msb(keySet->GetKeys().back()) + 1));
+
+    // Do the operation with both types of bit storage
+    SuperType A(bitsA, keySet);
+    SuperType B(bitsB, keySet);
+    SuperTypeRNS ARNS(bitsA, keySet);
+    SuperTypeRNS BRNS(bitsB, keySet);
+    SuperType resultsAB = TFUNCTION::Do(A, B);
+    SuperTypeRNS resultsABRNS = TFUNCTION::Do(ARNS, BRNS);
+
+    // Verify that every key decodes to the same value
+    printf("Result Verification...\n");
+    const std::vector<TINT> &keys = keySet->GetKeys();
+    for (size_t keyIndex = 0, keyCount = keys.size(); keyIndex < keyCount; ++keyIndex)
+    {
+        size_t result = resultsAB.DecodeBinary(keys[keyIndex]);
+        size_t resultRNS = resultsABRNS.DecodeBinary(keys[keyIndex]);
+        if (result != resultRNS)
+        {
+            std::cout << "  [" << keyIndex << "] (" << keys[keyIndex] << ") RNS = " << resultRNS << " (actually " << result << ")\n";
+            std::cout << "ERROR! incorrect value detected!\n";
+            return false;
+        }
+    }
+    printf("\n");
+    return true;
+}
+
+// Does an operation using the bit storage DispatchBitStorage() picks, and verifies
+// that every key decodes to the same value as TINT storage
+template <typename SuperType, typename TFUNCTION>
+struct SUnitTestBitStorage
+{
+    SUnitTestBitStorage (const std::shared_ptr<CKeySet> &keySet, const SuperType &expectedResult)
+        : m_keySet(keySet)
+        , m_expectedResult(expectedResult)
+    { }
+
+    template <typename TBIT>
+    bool Run ()
+    {
+        typedef CSuperInt<SuperType::c_numBits, TBIT> TSuperIntStorage;
+        std::vector<TINT>::const_iterator bitsA = m_keySet->GetSuperPositionedBits().begin();
+        std::vector<TINT>::const_iterator bitsB = bitsA + m_keySet->GetSuperPositionedBits().size() / 2;
+        TSuperIntStorage A(bitsA, m_keySet);
+        TSuperIntStorage B(bitsB, m_keySet);
+        TSuperIntStorage resultsAB = TFUNCTION::Do(A, B);
+
+        printf("Result Verification...\n");
+        const std::vector<TINT> &keys = m_keySet->GetKeys();
+        for (size_t keyIndex = 0, keyCount = keys.size(); keyIndex < keyCount; ++keyIndex)
+        {
+            size_t result = m_expectedResult.DecodeBinary(keys[keyIndex]);
+            size_t resultStorage = resultsAB.DecodeBinary(keys[keyIndex]);
+            if (result != resultStorage)
+            {
+                std::cout << "  [" << keyIndex << "] (" << keys[keyIndex] << ") fixed width = " << resultStorage << " (actually " << result << ")\n";
+                std::cout << "ERROR! incorrect value detected!\n";
+                return false;
+            }
+        }
+        printf("\n");
+        return true;
+    }
+
+    std::shared_ptr<CKeySet>    m_keySet;
+    const SuperType&            m_expectedResult;
+};
+
+template <typename SuperType, typename TFUNCTION>
+bool DoUnitTestFixedWidth (const char *name)
+{
+    printf("UnitTest: %s_FixedWidth\n", name);
+
+    std::vector<TINT>::const_iterator bitsA, bitsB;
+    std::shared_ptr<CKeySet> keySet = MakeUnitTestKeys<SuperType, TFUNCTION>(bitsA, bitsB);
+    printf("Keys LCM is %u bits, products need %u bits\n", unsigned(keySet->GetKeysLCMBits()), unsigned(FixedWidthBitsNeeded(*keySet)));
+
+    // Do the operation with TINT storage, then with whatever the dispatcher picks
+    SuperType A(bitsA, keySet);
+    SuperType B(bitsB, keySet);
+    SuperType resultsAB = TFUNCTION::Do(A, B);
+
+    SUnitTestBitStorage<SuperType, TFUNCTION> test(keySet, resultsAB);
+    if (!DispatchBitStorage(*keySet, test))
+        return false;
+
+    // DispatchBitStorage() only uses the smallest type that fits, so also try the 128 and
+    // 256 bit ones when they fit, to test native 128 bit and fixed width cpp_int storage
+    // on small keys
+    const size_t c_productBits = FixedWidthBitsNeeded(*keySet);
+    if (c_productBits <= 64)
+    {
+        printf("128 bit storage: ");
+        if (!test.template Run<CFixedWidthBit<128>>())
+            return false;
+    }
+    if (c_productBits <= 128)
+    {
+        printf("256 bit storage: ");
+        if (!test.template Run<CFixedWidthBit<256>>())
+            return false;
+    }
+    return true;
+}
+
+// Records an operation on two SuperTypes as a circuit, with A's bits as the first inputs
+// and B's as the rest
+template <typename SuperType, typename TFUNCTION>
+void RecordUnitTestCircuit (CCircuit &circuit)
+{
+    std::shared_ptr<CKeySet> recordKeySet = std::make_shared<CKeySet>();
+    recordKeySet->SetRecorder(&circuit);
+    std::vector<TINT> inputNodes(SuperType::c_numBits * 2);
+    for (TINT &node : inputNodes)
+        node = circuit.AddInput();
+    std::vector<TINT>::const_iterator nodesA = inputNodes.begin();
+    std::vector<TINT>::const_iterator nodesB = nodesA + SuperType::c_numBits;
+    SuperType recordA(nodesA, recordKeySet);
+    SuperType recordB(nodesB, recordKeySet);
+    SuperType recordResult = TFUNCTION::Do(recordA, recordB);
+    for (const TINT &bit : recordResult.GetBits())
+        circuit.AddOutput(bit);
+}
+
+// Records an operation as a circuit, writes it out (as text and as flat C++) and reads
+// it back, and verifies that replaying it against the keys decodes to the same values
+// as doing the math
+template <typename SuperType, typename TFUNCTION>
+bool DoUnitTestCircuit (const char *name)
+{
+    printf("UnitTest: %s_Circuit\n", name);
+
+    std::vector<TINT>::const_iterator bitsA, bitsB;
+    std::shared_ptr<CKeySet> keySet = MakeUnitTestKeys<SuperType, TFUNCTION>(bitsA, bitsB);
+
+    SuperType A(bitsA, keySet);
+    SuperType B(bitsB, keySet);
+    SuperType resultsAB = TFUNCTION::Do(A, B);
+
+    // record the same operation, with circuit nodes as the bits
+    CCircuit circuit;
+    RecordUnitTestCircuit<SuperType, TFUNCTION>(circuit);
+    printf("%u XOR gates, %u AND gates\n", unsigned(circuit.GetNumGates(ECircuitNode::XOR)), unsigned(circuit.GetNumGates(ECircuitNode::AND)));
+
+    std::string circuitName = std::string("Circuit_") + name;
+    std::string fileName = circuitName + ".txt";
+    CCircuit replay;
+    if (!circuit.Write(fileName.c_str()) || !replay.Read(fileName.c_str()))
+    {
+        std::cout << "ERROR! could not write and read " << fileName << "\n";
+        return false;
+    }
+
+    // also write it as flat code for these keys
+    std::string cppFileName = circuitName + ".cpp";
+    if (!circuit.WriteCpp(cppFileName.c_str(), circuitName.c_str(), keySet->GetKeysLCMBits(), keySet->GetKeysLCMBits() * 2))
+    {
+        std::cout << "ERROR! could not write " << cppFileName << "\n";
+        return false;
+    }
+
+    std::vector<TINT> inputs(A.GetBits().begin(), A.GetBits().end());
+    inputs.insert(inputs.end(), B.GetBits().begin(), B.GetBits().end());
+    std::vector<TINT> outputs;
+    replay.Evaluate(inputs, *keySet, outputs);
+    std::vector<TINT>::const_iterator outputsBegin = outputs.begin();
+    SuperType replayResult(outputsBegin, keySet);
+
+    // the optimized circuit has to decode the same too
+    CCircuit optimized(replay);
+    optimized.Optimize();
+    printf("Optimized to %u XOR gates, %u AND gates\n", unsigned(optimized.GetNumGates(ECircuitNode::XOR)), unsigned(optimized.GetNumGates(ECircuitNode::AND)));
+    optimized.Evaluate(inputs, *keySet, outputs);
+    outputsBegin = outputs.begin();
+    SuperType optimizedResult(outputsBegin, keySet);
+
+    // compare bits, since CSuperInt and CSuperFixed decode differently
+    printf("Result Verification...\n");
+    const std::vector<TINT> &keys = keySet->GetKeys();
+    for (size_t keyIndex = 0, keyCount = keys.size(); keyIndex < keyCount; ++keyIndex)
+    {
+        size_t result = 0;
+        size_t resultReplay = 0;
+        size_t resultOptimized = 0;
+        for (size_t i = 0; i < SuperType::c_numBits; ++i)
+        {
+            result |= DecodeBit(resultsAB.GetBits()[i], keys[keyIndex], *keySet) << i;
+            resultReplay |= DecodeBit(replayResult.GetBits()[i], keys[keyIndex], *keySet) << i;
+            resultOptimized |= DecodeBit(optimizedResult.GetBits()[i], keys[keyIndex], *keySet) << i;
+        }
+        if (result != resultReplay || result != resultOptimized)
+        {
+            std::cout << "  [" << keyIndex << "] (" << keys[keyIndex] << ") circuit = " << resultReplay << ", optimized = " << resultOptimized << " (actually " << result << ")\n";
+            std::cout << "ERROR! incorrect value detected!\n";
+            return false;
+        }
+    }
+    printf("\n");
+    return true;
+}
+
+// The flat C++ CCircuit::WriteCpp() makes for a 2 bit add, for the keys that
+// DoUnitTestCircuitCpp() uses.  It's in a namespace to keep its typedefs to itself.
+namespace UnitTestKernel
+{
+    #include "UnitTestKernel_Int_Add.cpp"
+}
+
+// Writes the flat C++ for a 2 bit add and checks that it's the same as
+// UnitTestKernel_Int_Add.cpp, which is compiled into the unit tests.  Then runs that
+// against the keys and checks that it gives the same values mod the LCM as replaying
+// the circuit.  When WriteCpp() changes what it writes, copy the newly written file
+// over UnitTestKernel_Int_Add.cpp after checking it.
+bool DoUnitTestCircuitCpp ()
+{
+    typedef TSuperIntSmall SuperType;
+    typedef SUnitTestFunction_Int_Add TFUNCTION;
+    static const size_t c_numInputs = SuperType::c_numBits * 2;
+    printf("UnitTest: Int_Add_CircuitCpp\n");
+
+    // the keys aren't cached, so they are always the ones the kernel was written for
+    std::shared_ptr<CKeySet> keySet = std::make_shared<CKeySet>();
+    keySet->Calculate(int(c_numInputs), FindUnitTestMinKey<SuperType, TFUNCTION>());
+    const size_t c_lcmBits = keySet->GetKeysLCMBits();
+    printf("Keys LCM is %u bits\n", unsigned(c_lcmBits));
+
+    CCircuit circuit;
+    RecordUnitTestCircuit<SuperType, TFUNCTION>(circuit);
+
+    // reduce any value wider than the LCM, so the Barrett code gets used
+    const char *c_kernelName = "UnitTestKernel_Int_Add";
+    const std::string c_fileName = std::string(c_kernelName) + ".cpp";
+    if (!circuit.WriteCpp(c_fileName.c_str(), c_kernelName, c_lcmBits, c_lcmBits))
+    {
+        std::cout << "ERROR! could not write " << c_fileName << "\n";
+        return false;
+    }
+
+    // the compiled in kernel is next to this file
+    std::string referenceFileName(__FILE__);
+    referenceFileName = referenceFileName.substr(0, referenceFileName.find_last_of("/\\") + 1) + c_fileName;
+    std::ifstream file(c_fileName.c_str());
+    std::ifstream referenceFile(referenceFileName.c_str());
+    // line endings depend on the platform and on how the file was checked out
+    std::string written((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::string reference((std::istreambuf_iterator<char>(referenceFile)), std::istreambuf_iterator<char>());
+    written.erase(std::remove(written.begin(), written.end(), '\r'), written.end());
+    reference.erase(std::remove(reference.begin(), reference.end(), '\r'), reference.end());
+    if (written.empty() || written != reference)
+    {
+        std::cout << "ERROR! " << c_fileName << " is different from " << referenceFileName << "\n";
+        return false;
+    }
+
+    // run the kernel and the circuit on the superpositional bits
+    const std::vector<TINT> &bits = keySet->GetSuperPositionedBits();
+    std::vector<TINT> inputs(bits.begin(), bits.begin() + c_numInputs);
+    std::vector<TINT> outputs;
+    circuit.Evaluate(inputs, *keySet, outputs);
+
+    CBarrettReducer reducer;
+    reducer.SetModulus(keySet->GetKeysLCM());
+    std::vector<uint64_t> limbs;
+    UnitTestKernel::TReduce lcm, reciprocal;
+    TINTToLimbs(keySet->GetKeysLCM(), limbs);
+    FixedWidthFromLimbs(limbs, lcm);
+    TINTToLimbs(reducer.GetReciprocal(), limbs);
+    FixedWidthFromLimbs(limbs, reciprocal);
+
+    UnitTestKernel::TInput kernelInputs[c_numInputs];
+    UnitTestKernel::TOutput kernelOutputs[SuperType::c_numBits];
+    for (size_t i = 0; i < c_numInputs; ++i)
+    {
+        TINTToLimbs(inputs[i], limbs);
+        FixedWidthFromLimbs(limbs, kernelInputs[i]);
+    }
+    UnitTestKernel::UnitTestKernel_Int_Add(kernelInputs, kernelOutputs, lcm, reciprocal);
+
+    printf("Result Verification...\n");
+    for (size_t i = 0; i < SuperType::c_numBits; ++i)
+    {
+        const TINT c_kernelOutput = FixedWidthToTINT(kernelOutputs[i]) % keySet->GetKeysLCM();
+        const TINT c_output = outputs[i] % keySet->GetKeysLCM();
+        if (c_kernelOutput != c_output)
+        {
+            std::cout << "  output " << i << " = " << c_kernelOutput << " (actually " << c_output << ")\n";
+            std::cout << "ERROR! incorrect value detected!\n";
+            return false;
+        }
+    }
+    printf("\n");
+    return true;
+}
+
+// Checks that reading a key file that is corrupt, or cut short, fails instead of
+// leaving a half read key set that can't reduce
+bool DoUnitTestReadBadKeyFile ()
+{
+    printf("UnitTest: ReadBadKeyFile\n");
+
+    // write a good key file, and a copy of it cut off part way through the keys
+    CKeySet keySet;
+    keySet.Calculate(2, 5);
+    const char *c_goodFileName = "UnitTestKeys.txt";
+    const char *c_truncatedFileName = "UnitTestKeys_Truncated.txt";
+    const char *c_corruptFileName = "UnitTestKeys_Corrupt.txt";
+    if (!keySet.Write(c_goodFileName))
+    {
+        std::cout << "ERROR! could not write " << c_goodFileName << "\n";
+        return false;
+    }
+    std::ifstream goodFile(c_goodFileName);
+    std::string contents((std::istreambuf_iterator<char>(goodFile)), std::istreambuf_iterator<char>());
+    goodFile.close();
+    std::ofstream(c_truncatedFileName) << contents.substr(0, contents.size() / 2);
+    std::ofstream(c_corruptFileName) << "garbage\n";
+
+    bool success = true;
+    const char *c_badFileNames[] = { c_corruptFileName, c_truncatedFileName };
+    for (const char *fileName : c_badFileNames)
+    {
+        CKeySet badKeySet;
+        if (badKeySet.Read(fileName) || !badKeySet.GetKeys().empty() || badKeySet.GetKeysLCM() != 1)
+        {
+            std::cout << "ERROR! reading " << fileName << " didn't fail cleanly\n";
+            success = false;
+        }
+    }
+
+    // reading the good file still works after a failed read
+    CKeySet readKeySet;
+    readKeySet.Read(c_corruptFileName);
+    if (!readKeySet.Read(c_goodFileName) || readKeySet.GetKeys() != keySet.GetKeys() || readKeySet.GetKeysLCM() != keySet.GetKeysLCM())
+    {
+        std::cout << "ERROR! could not read " << c_goodFileName << " back\n";
+        success = false;
+    }
+
+    std::remove(c_goodFileName);
+    std::remove(c_truncatedFileName);
+    std::remove(c_corruptFileName);
+    printf("\n");
+    return success;
+}
+
 // The function to do all the unit tests
 void DoUnitTests ()
 {
@@ -120,4 +513,34 @@ void DoUnitTests ()
         if (!DoUnitTest_##Name()) \
             return;
     #include "UnitTestList.h"
+
+    if (!DoUnitTestRNS<TSuperInt, TSuperIntRNS, SUnitTestFunction_Int_Multiply>("Int_Multiply"))
+        return;
+
+    if (!DoUnitTestRNS<TSuperIntSmall, TSuperIntSmallRNS, SUnitTestFunction_Int_Divide>("Int_Divide"))
+        return;
+
+    if (!DoUnitTestFixedWidth<TSuperInt, SUnitTestFunction_Int_Multiply>("Int_Multiply"))
+        return;
+
+    if (!DoUnitTestFixedWidth<TSuperIntTiny, SUnitTestFunction_Int_Add>("Int_Add"))
+        return;
+
+    if (!DoUnitTestFixedWidth<TSuperIntTiny, SUnitTestFunction_Int_Multiply>("Int_Multiply"))
+        return;
+
+    if (!DoUnitTestFixedWidth<TSuperIntSmall, SUnitTestFunction_Int_Multiply>("Int_Multiply"))
+        return;
+
+    if (!DoUnitTestCircuit<TSuperInt, SUnitTestFunction_Int_Divide>("Int_Divide"))
+        return;
+
+    if (!DoUnitTestCircuit<TSuperFixed, SUnitTestFunction_Fixed_Add>("Fixed_Add"))
+        return;
+
+    if (!DoUnitTestCircuitCpp())
+        return;
+
+    if (!DoUnitTestReadBadKeyFile())
+        return;
 }
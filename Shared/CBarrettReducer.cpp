@@ -0,0 +1,38 @@
+//=================================================================================
+//
+//  CBarrettReducer
+//
+//  Reduces values modulo a fixed modulus without a long division
+//
+//=================================================================================
+
+#include "CBarrettReducer.h"
+#include "Macros.h"
+
+//=================================================================================
+void CBarrettReducer::SetModulus (const TINT& modulus)
+{
+    Assert_(modulus > 1);
+    m_modulus = modulus;
+    m_modulusBits = unsigned(boost::multiprecision::msb(modulus)) + 1;
+    m_reciprocal = (TINT(1) << (2 * m_modulusBits)) / modulus;
+}
+
+//=================================================================================
+void CBarrettReducer::ReduceSlow (TINT& v) const
+{
+    // negative values and values too large for the reciprocal take the slow path
+    if (v.sign() < 0 || boost::multiprecision::msb(v) >= 2 * m_modulusBits)
+    {
+        v = v % m_modulus;
+        return;
+    }
+
+    // the estimate of v / modulus is at most 2 too small
+    TINT q = v >> (m_modulusBits - 1);
+    q *= m_reciprocal;
+    q >>= (m_modulusBits + 1);
+    v -= q * m_modulus;
+    while (v >= m_modulus)
+        v -= m_modulus;
+}
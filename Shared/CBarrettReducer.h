@@ -0,0 +1,48 @@
+//=================================================================================
+//
+//  CBarrettReducer
+//
+//  Reduces values modulo a fixed modulus without a long division, using Barrett
+//  reduction.  A reciprocal of the modulus is calculated once, after which a
+//  reduction costs two multiplies, a subtraction and some shifts.
+//
+//  Sums of two reduced values (XOR) only need a single subtraction, and products of
+//  two reduced values (AND) are less than modulus^2, which is the range Barrett
+//  reduction works in.  Anything else falls back to a division.
+//
+//=================================================================================
+
+#pragma once
+
+#include "TINT.h"
+
+class CBarrettReducer
+{
+public:
+    CBarrettReducer () : m_modulusBits(0) {}
+
+    // calculates the reciprocal.  The modulus must be greater than 1, which is asserted, so a
+    // modulus that comes from data (like a key file) needs checking first.  See CKeySet.
+    void SetModulus (const TINT& modulus);
+
+    const TINT& GetModulus () const { return m_modulus; }
+    size_t GetModulusBits () const { return m_modulusBits; }
+    const TINT& GetReciprocal () const { return m_reciprocal; }
+
+    // v = v % modulus
+    void Reduce (TINT& v) const
+    {
+        // values that are already reduced are common, such as ANDs against 0 or 1
+        if (v.sign() >= 0 && v < m_modulus)
+            return;
+        ReduceSlow(v);
+    }
+
+private:
+    void ReduceSlow (TINT& v) const;
+
+private:
+    TINT        m_modulus;
+    TINT        m_reciprocal;   // floor(2^(2k) / modulus)
+    unsigned    m_modulusBits;  // k
+};
@@ -0,0 +1,589 @@
+//=================================================================================
+//
+//  CCircuit
+//
+//  A gate graph recorded from CSuperInt / CSuperFixed math
+//
+//=================================================================================
+
+#include "CCircuit.h"
+#include "CSuperInt.h"
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <map>
+#include <algorithm>
+
+//=================================================================================
+void CCircuit::Clear ()
+{
+    m_nodes.clear();
+    m_outputs.clear();
+    m_numInputs = 0;
+    AddNode(ECircuitNode::Constant, 0, 0);
+    AddNode(ECircuitNode::Constant, 1, 0);
+}
+
+//=================================================================================
+TINT CCircuit::AddInput ()
+{
+    return TINT(AddNode(ECircuitNode::Input, uint32_t(m_numInputs++), 0));
+}
+
+//=================================================================================
+void CCircuit::AddOutput (const TINT& node)
+{
+    m_outputs.push_back(NodeFromTINT(node));
+}
+
+//=================================================================================
+TINT CCircuit::AddGate (ECircuitNode type, const TINT& A, const TINT& B)
+{
+    Assert_(type == ECircuitNode::XOR || type == ECircuitNode::AND);
+    return TINT(AddNode(type, NodeFromTINT(A), NodeFromTINT(B)));
+}
+
+//=================================================================================
+size_t CCircuit::GetNumGates (ECircuitNode type) const
+{
+    size_t count = 0;
+    for (const SCircuitNode& node : m_nodes)
+    {
+        if (node.m_type == type)
+            ++count;
+    }
+    return count;
+}
+
+//=================================================================================
+uint32_t CCircuit::NodeFromTINT (const TINT& node) const
+{
+    // anything else means a value that didn't come from this circuit got mixed in
+    Assert_(node >= 0 && node < m_nodes.size());
+    return node.convert_to<uint32_t>();
+}
+
+//=================================================================================
+uint32_t CCircuit::AddNode (ECircuitNode type, uint32_t a, uint32_t b)
+{
+    SCircuitNode node;
+    node.m_type = type;
+    node.m_a = a;
+    node.m_b = b;
+    m_nodes.push_back(node);
+    return uint32_t(m_nodes.size() - 1);
+}
+
+//=================================================================================
+void CCircuit::Optimize ()
+{
+    // Pass 1: fold and merge gates, building a new node list.  remap is where each old
+    // node ended up.
+    std::vector<SCircuitNode> nodes;
+    std::vector<uint32_t> remap(m_nodes.size());
+    std::map<std::pair<uint64_t, ECircuitNode>, uint32_t> gates;
+    nodes.reserve(m_nodes.size());
+    for (uint32_t i = 0; i < m_nodes.size(); ++i)
+    {
+        SCircuitNode node = m_nodes[i];
+        if (node.m_type == ECircuitNode::Constant || node.m_type == ECircuitNode::Input)
+        {
+            remap[i] = uint32_t(nodes.size());
+            nodes.push_back(node);
+            continue;
+        }
+
+        // gates are commutative, so put the lower node first
+        uint32_t a = remap[node.m_a];
+        uint32_t b = remap[node.m_b];
+        if (b < a)
+            std::swap(a, b);
+
+        if (node.m_type == ECircuitNode::XOR)
+        {
+            if (a == c_zeroNode)
+            {
+                remap[i] = b;
+                continue;
+            }
+            if (a == b)
+            {
+                remap[i] = c_zeroNode;
+                continue;
+            }
+
+            // (A XOR 1) XOR 1 is A + 2, which decodes the same as A
+            if (a == c_oneNode && nodes[b].m_type == ECircuitNode::XOR && nodes[b].m_a == c_oneNode)
+            {
+                remap[i] = nodes[b].m_b;
+                continue;
+            }
+        }
+        else
+        {
+            if (a == c_zeroNode || a == c_oneNode)
+            {
+                remap[i] = a == c_zeroNode ? c_zeroNode : b;
+                continue;
+            }
+        }
+
+        const std::pair<uint64_t, ECircuitNode> c_key((uint64_t(a) << 32) | b, node.m_type);
+        auto existing = gates.find(c_key);
+        if (existing != gates.end())
+        {
+            remap[i] = existing->second;
+            continue;
+        }
+
+        node.m_a = a;
+        node.m_b = b;
+        remap[i] = uint32_t(nodes.size());
+        gates[c_key] = remap[i];
+        nodes.push_back(node);
+    }
+
+    // Pass 2: keep the constants, the inputs, and the gates the outputs depend on
+    std::vector<bool> used(nodes.size(), false);
+    for (uint32_t output : m_outputs)
+        used[remap[output]] = true;
+    for (size_t i = nodes.size(); i > 0; --i)
+    {
+        const SCircuitNode& node = nodes[i - 1];
+        if (!used[i - 1])
+            continue;
+        if (node.m_type == ECircuitNode::XOR || node.m_type == ECircuitNode::AND)
+        {
+            used[node.m_a] = true;
+            used[node.m_b] = true;
+        }
+    }
+
+    std::vector<uint32_t> compact(nodes.size());
+    m_nodes.clear();
+    for (uint32_t i = 0; i < nodes.size(); ++i)
+    {
+        SCircuitNode node = nodes[i];
+        if (node.m_type == ECircuitNode::XOR || node.m_type == ECircuitNode::AND)
+        {
+            if (!used[i])
+                continue;
+            node.m_a = compact[node.m_a];
+            node.m_b = compact[node.m_b];
+        }
+        compact[i] = uint32_t(m_nodes.size());
+        m_nodes.push_back(node);
+    }
+
+    for (uint32_t &output : m_outputs)
+        output = compact[remap[output]];
+}
+
+//=================================================================================
+// The file is text.  The first line is the node count, input count and output count,
+// then one line per node, then one line per output:
+//   c <value>      constant
+//   i <index>      input
+//   x <a> <b>      XOR
+//   a <a> <b>      AND
+//   o <node>       output
+//=================================================================================
+bool CCircuit::Write (const char *fileName) const
+{
+    std::ofstream file;
+    file.open(fileName, std::ios::out | std::ios::trunc);
+
+    if (!file.is_open())
+        return false;
+
+    file << m_nodes.size() << " " << m_numInputs << " " << m_outputs.size() << "\n";
+    for (const SCircuitNode& node : m_nodes)
+    {
+        switch (node.m_type)
+        {
+            case ECircuitNode::Constant: file << "c " << node.m_a << "\n"; break;
+            case ECircuitNode::Input: file << "i " << node.m_a << "\n"; break;
+            case ECircuitNode::XOR: file << "x " << node.m_a << " " << node.m_b << "\n"; break;
+            case ECircuitNode::AND: file << "a " << node.m_a << " " << node.m_b << "\n"; break;
+        }
+    }
+    for (uint32_t output : m_outputs)
+        file << "o " << output << "\n";
+
+    bool ret = !file.fail();
+    file.close();
+    return ret;
+}
+
+//=================================================================================
+bool CCircuit::Read (const char *fileName)
+{
+    std::ifstream file;
+    file.open(fileName);
+
+    if (!file.is_open())
+        return false;
+
+    m_nodes.clear();
+    m_outputs.clear();
+    m_numInputs = 0;
+
+    bool ret = false;
+    do
+    {
+        size_t numNodes, numInputs, numOutputs;
+        file >> numNodes >> numInputs >> numOutputs;
+        if (file.fail())
+            break;
+
+        bool valid = true;
+        m_nodes.reserve(numNodes);
+        for (size_t i = 0; i < numNodes && valid; ++i)
+        {
+            char type;
+            SCircuitNode node;
+            node.m_b = 0;
+            file >> type >> node.m_a;
+            switch (type)
+            {
+                case 'c': node.m_type = ECircuitNode::Constant; valid = node.m_a <= 1; break;
+                case 'i': node.m_type = ECircuitNode::Input; valid = node.m_a < numInputs; break;
+                case 'x': node.m_type = ECircuitNode::XOR; file >> node.m_b; break;
+                case 'a': node.m_type = ECircuitNode::AND; file >> node.m_b; break;
+                default: valid = false; break;
+            }
+
+            // gates may only use nodes before them, so the file is in evaluation order
+            if (node.m_type == ECircuitNode::XOR || node.m_type == ECircuitNode::AND)
+                valid = valid && node.m_a < i && node.m_b < i;
+            valid = valid && !file.fail();
+            m_nodes.push_back(node);
+        }
+
+        for (size_t i = 0; i < numOutputs && valid; ++i)
+        {
+            char type;
+            uint32_t output;
+            file >> type >> output;
+            valid = !file.fail() && type == 'o' && output < numNodes;
+            m_outputs.push_back(output);
+        }
+
+        m_numInputs = numInputs;
+        ret = valid;
+    }
+    while (0);
+
+    file.close();
+
+    if (!ret)
+        Clear();
+    return ret;
+}
+
+//=================================================================================
+// The generated code tracks an upper bound on how many bits each value has.  Values
+// are never negative, so A XOR B = A + B needs one more bit than the wider input, and
+// A AND B = A * B needs the sum of the input bits.  Each value is kept in the smallest
+// integer with a multiple of 64 bits that it fits in: uint64_t, or a fixed width
+// cpp_int.  Values only live in a variable until the last gate that reads them, and
+// variables of the same width are reused, so the stack stays small however many gates
+// there are.
+//
+// When a gate's result would have more than reduceBits bits, its inputs that are wider
+// than the LCM are reduced first (in place, since whatever reads them later only needs
+// a value that's the same mod the LCM), then the result is reduced if it's still too
+// wide.  That keeps everything that gets reduced less than 2^(2 * inputBits), which is
+// the range Barrett reduction works in.  Division of wide fixed width cpp_ints is slow
+// (see CFixedWidthBit), so it isn't used.
+//=================================================================================
+static size_t CppTypeBits (size_t bits)
+{
+    return bits <= 64 ? 64 : (bits + 63) / 64 * 64;
+}
+
+//=================================================================================
+static std::string CppTypeName (size_t bits)
+{
+    if (CppTypeBits(bits) == 64)
+        return "uint64_t";
+    std::ostringstream name;
+    name << "TUInt" << CppTypeBits(bits);
+    return name.str();
+}
+
+//=================================================================================
+static bool IsGate (const SCircuitNode& node)
+{
+    return node.m_type == ECircuitNode::XOR || node.m_type == ECircuitNode::AND;
+}
+
+//=================================================================================
+static size_t GateResultBits (const SCircuitNode& node, size_t bitsA, size_t bitsB)
+{
+    if (node.m_type == ECircuitNode::XOR)
+        return bitsA == 0 ? bitsB : (bitsB == 0 ? bitsA : std::max(bitsA, bitsB) + 1);
+    if (bitsA == 0 || bitsB == 0)
+        return 0;
+    if (node.m_a == CCircuit::c_oneNode || node.m_b == CCircuit::c_oneNode)
+        return node.m_a == CCircuit::c_oneNode ? bitsB : bitsA;
+    return bitsA + bitsB;
+}
+
+//=================================================================================
+bool CCircuit::WriteCpp (const char *fileName, const char *functionName, size_t inputBits, size_t reduceBits) const
+{
+    // products of two reduced values are as wide as anything gets before it's reduced
+    if (reduceBits > inputBits * 2)
+        reduceBits = inputBits * 2;
+    const std::string c_reduceType = CppTypeName(inputBits * 2 + 3);
+    const std::string c_reduceFunction = std::string(functionName) + "_Reduce";
+
+    // outputs are written as soon as they are calculated, so only gates read values later
+    std::vector<uint32_t> lastUse(m_nodes.size(), 0);
+    for (uint32_t i = 0; i < m_nodes.size(); ++i)
+    {
+        const SCircuitNode& node = m_nodes[i];
+        if (IsGate(node))
+        {
+            lastUse[node.m_a] = i;
+            lastUse[node.m_b] = i;
+        }
+    }
+
+    // the expression each node is read with, and how many bits it has
+    std::vector<std::string> names(m_nodes.size());
+    std::vector<size_t> bits(m_nodes.size(), 0);
+
+    // the bits of the type of each gate's variable, which stays the same when the value is reduced
+    std::vector<size_t> typeBits(m_nodes.size(), 0);
+
+    // variables, by type bits.  free ones can be reused.
+    std::map<size_t, size_t> numVariables;
+    std::map<size_t, std::vector<std::string>> freeVariables;
+
+    // every type the code uses, by bits
+    std::map<size_t, bool> types;
+    types[CppTypeBits(inputBits)] = true;
+
+    size_t maxBits = inputBits;
+    size_t numReductions = 0;
+
+    std::ostringstream body;
+    for (uint32_t i = 0; i < m_nodes.size(); ++i)
+    {
+        const SCircuitNode& node = m_nodes[i];
+        if (node.m_type == ECircuitNode::Constant)
+        {
+            names[i] = node.m_a ? "1" : "0";
+            bits[i] = node.m_a ? 1 : 0;
+        }
+        else if (node.m_type == ECircuitNode::Input)
+        {
+            std::ostringstream name;
+            name << "inputs[" << node.m_a << "]";
+            names[i] = name.str();
+            bits[i] = inputBits;
+        }
+        else
+        {
+            size_t resultBits = GateResultBits(node, bits[node.m_a], bits[node.m_b]);
+            bool reduceResult = false;
+            if (reduceBits > 0 && resultBits > reduceBits)
+            {
+                for (uint32_t operand : { node.m_a, node.m_b })
+                {
+                    if (bits[operand] <= inputBits)
+                        continue;
+                    body << "    " << names[operand] << " = " << CppTypeName(typeBits[operand]) << "(" << c_reduceFunction << "(" << c_reduceType << "(" << names[operand] << "), lcm, reciprocal));\n";
+                    bits[operand] = inputBits;
+                    ++numReductions;
+                }
+                resultBits = GateResultBits(node, bits[node.m_a], bits[node.m_b]);
+                reduceResult = resultBits > reduceBits;
+            }
+            maxBits = std::max(maxBits, resultBits);
+
+            const std::string c_type = CppTypeName(resultBits);
+            types[CppTypeBits(resultBits)] = true;
+            std::ostringstream expression;
+            expression << c_type << "(" << names[node.m_a] << ") " << (node.m_type == ECircuitNode::XOR ? "+" : "*") << " " << c_type << "(" << names[node.m_b] << ")";
+
+            if (reduceResult)
+            {
+                ++numReductions;
+                resultBits = inputBits;
+            }
+
+            // free the inputs if this is the last gate to read them, so the result can
+            // go in one of their variables
+            for (uint32_t operand : { node.m_a, node.m_b })
+            {
+                if (lastUse[operand] == i && IsGate(m_nodes[operand]))
+                {
+                    freeVariables[typeBits[operand]].push_back(names[operand]);
+                    lastUse[operand] = 0;
+                }
+            }
+
+            std::vector<std::string>& freeList = freeVariables[CppTypeBits(resultBits)];
+            if (freeList.empty())
+            {
+                std::ostringstream name;
+                name << "v" << CppTypeBits(resultBits) << "_" << numVariables[CppTypeBits(resultBits)]++;
+                names[i] = name.str();
+            }
+            else
+            {
+                names[i] = freeList.back();
+                freeList.pop_back();
+            }
+            bits[i] = resultBits;
+            typeBits[i] = CppTypeBits(resultBits);
+
+            body << "    " << names[i] << " = ";
+            if (reduceResult)
+                body << CppTypeName(resultBits) << "(" << c_reduceFunction << "(" << c_reduceType << "(" << expression.str() << "), lcm, reciprocal));";
+            else
+                body << expression.str() << ";";
+            body << "  // " << i << (node.m_type == ECircuitNode::XOR ? " XOR" : " AND") << ", " << bits[i] << " bits\n";
+        }
+
+        for (size_t outputIndex = 0; outputIndex < m_outputs.size(); ++outputIndex)
+        {
+            if (m_outputs[outputIndex] == i)
+                body << "    outputs[" << outputIndex << "] = TOutput(" << names[i] << ");\n";
+        }
+
+        // gates nothing reads, like ones that only feed an output
+        if (lastUse[i] == 0 && IsGate(node))
+            freeVariables[typeBits[i]].push_back(names[i]);
+    }
+
+    size_t outputBits = inputBits;
+    for (uint32_t output : m_outputs)
+        outputBits = std::max(outputBits, bits[output]);
+    types[CppTypeBits(outputBits)] = true;
+    types[CppTypeBits(inputBits * 2 + 3)] = true;
+
+    std::ofstream file;
+    file.open(fileName, std::ios::out | std::ios::trunc);
+
+    if (!file.is_open())
+        return false;
+
+    file << "//=================================================================================\n";
+    file << "//\n";
+    file << "//  " << functionName << "\n";
+    file << "//\n";
+    file << "//  Generated by CCircuit::WriteCpp().  " << GetNumGates(ECircuitNode::XOR) << " XOR gates, " << GetNumGates(ECircuitNode::AND) << " AND gates, ";
+    file << numReductions << " reductions, " << maxBits << " bits at most.\n";
+    file << "//\n";
+    file << "//  inputs are " << m_numInputs << " superpositional bits less than the keys LCM, which has " << inputBits << " bits.\n";
+    file << "//  lcm is the LCM and reciprocal is its Barrett reciprocal, floor(2^" << inputBits * 2 << " / lcm).  outputs\n";
+    file << "//  are the same mod the LCM as what the recorded math gives.\n";
+    file << "//\n";
+    file << "//=================================================================================\n\n";
+    file << "#include <stdint.h>\n";
+    file << "#include <boost/multiprecision/cpp_int.hpp>\n\n";
+
+    for (const auto& type : types)
+    {
+        if (type.first == 64)
+            continue;
+        file << "typedef boost::multiprecision::number<boost::multiprecision::cpp_int_backend<" << type.first << ", " << type.first;
+        file << ", boost::multiprecision::unsigned_magnitude, boost::multiprecision::unchecked, void>> " << CppTypeName(type.first) << ";\n";
+    }
+    file << "typedef " << CppTypeName(inputBits) << " TInput;\n";
+    file << "typedef " << CppTypeName(outputBits) << " TOutput;\n";
+    file << "typedef " << c_reduceType << " TReduce;\n\n";
+
+    // Barrett reduction.  Fixed width cpp_int products that fill the whole type can
+    // come out with zero high limbs, which breaks comparisons and subtraction, so those
+    // are normalized.
+    file << "//=================================================================================\n";
+    file << "static TReduce " << c_reduceFunction << " (TReduce v, const TReduce &lcm, const TReduce &reciprocal)\n";
+    file << "{\n";
+    if (CppTypeBits(inputBits * 2 + 3) == 64)
+    {
+        file << "    return v % lcm;\n";
+    }
+    else
+    {
+        file << "    v.backend().normalize();\n";
+        file << "    TReduce q = v >> " << (inputBits - 1) << ";\n";
+        file << "    q *= reciprocal;\n";
+        file << "    q.backend().normalize();\n";
+        file << "    q >>= " << (inputBits + 1) << ";\n";
+        file << "    q *= lcm;\n";
+        file << "    q.backend().normalize();\n";
+        file << "    v -= q;\n";
+        file << "    while (v >= lcm)\n";
+        file << "        v -= lcm;\n";
+        file << "    return v;\n";
+    }
+    file << "}\n\n";
+
+    file << "//=================================================================================\n";
+    file << "void " << functionName << " (const TInput inputs[" << std::max<size_t>(m_numInputs, 1) << "], TOutput outputs[" << std::max<size_t>(m_outputs.size(), 1) << "], const TReduce &lcm, const TReduce &reciprocal)\n";
+    file << "{\n";
+    for (const auto& count : numVariables)
+    {
+        for (size_t i = 0; i < count.second; ++i)
+            file << "    " << CppTypeName(count.first) << " v" << count.first << "_" << i << ";\n";
+    }
+    file << "\n";
+    file << body.str();
+    file << "}\n";
+
+    bool ret = !file.fail();
+    file.close();
+    return ret;
+}
+
+//=================================================================================
+void CCircuit::Evaluate (const std::vector<TINT>& inputs, const CKeySet& keySet, std::vector<TINT>& outputs) const
+{
+    Assert_(inputs.size() == m_numInputs);
+
+    // free each value after the last gate that uses it, so big circuits don't keep every
+    // intermediate bit around
+    const uint32_t c_keep = uint32_t(-1);
+    std::vector<uint32_t> lastUse(m_nodes.size(), 0);
+    for (uint32_t i = 0; i < m_nodes.size(); ++i)
+    {
+        const SCircuitNode& node = m_nodes[i];
+        if (node.m_type == ECircuitNode::XOR || node.m_type == ECircuitNode::AND)
+        {
+            lastUse[node.m_a] = i;
+            lastUse[node.m_b] = i;
+        }
+    }
+    for (uint32_t output : m_outputs)
+        lastUse[output] = c_keep;
+
+    std::vector<TINT> values(m_nodes.size());
+    for (uint32_t i = 0; i < m_nodes.size(); ++i)
+    {
+        const SCircuitNode& node = m_nodes[i];
+        switch (node.m_type)
+        {
+            case ECircuitNode::Constant: values[i] = node.m_a; break;
+            case ECircuitNode::Input: values[i] = inputs[node.m_a]; break;
+            case ECircuitNode::XOR: values[i] = XOR(values[node.m_a], values[node.m_b], keySet); break;
+            case ECircuitNode::AND: values[i] = AND(values[node.m_a], values[node.m_b], keySet); break;
+        }
+
+        if (node.m_type == ECircuitNode::XOR || node.m_type == ECircuitNode::AND)
+        {
+            if (lastUse[node.m_a] == i)
+                values[node.m_a] = 0;
+            if (lastUse[node.m_b] == i)
+                values[node.m_b] = 0;
+        }
+    }
+
+    outputs.resize(m_outputs.size());
+    for (size_t i = 0; i < m_outputs.size(); ++i)
+        outputs[i] = values[m_outputs[i]];
+}
@@ -0,0 +1,105 @@
+//=================================================================================
+//
+//  CCircuit
+//
+//  A gate graph recorded from CSuperInt / CSuperFixed math, or anything else that
+//  uses the TINT HE operations.
+//
+//  To record, give a key set a circuit with CKeySet::SetRecorder().  While recording,
+//  XOR and AND on TINTs add a gate to the circuit instead of doing bigint math, and
+//  return the new gate's node index as the TINT value.  Nodes 0 and 1 are the
+//  constants 0 and 1, so plaintext bits (like the ones SetInt() and ShiftLeft() make)
+//  are already the right nodes.  Superpositional inputs come from AddInput().
+//
+//  A recorded circuit can be written to and read from a text file, evaluated
+//  against a real key set with Evaluate(), or turned into flat C++ with WriteCpp().
+//
+//  Only TINT bits are recorded, not other bit storage types like CRNSBit.  Recording
+//  is not thread safe.  Record on one thread.
+//
+//=================================================================================
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "TINT.h"
+
+class CKeySet;
+
+//=================================================================================
+enum class ECircuitNode : uint8_t
+{
+    Constant,   // m_a is the value, 0 or 1
+    Input,      // m_a is the input index
+    XOR,        // m_a XOR m_b
+    AND,        // m_a AND m_b
+};
+
+struct SCircuitNode
+{
+    ECircuitNode    m_type;
+    uint32_t        m_a;
+    uint32_t        m_b;
+};
+
+//=================================================================================
+class CCircuit
+{
+public:
+    static const uint32_t c_zeroNode = 0;
+    static const uint32_t c_oneNode = 1;
+
+    CCircuit () { Clear(); }
+
+    // back to just the two constant nodes
+    void Clear ();
+
+    // adds a superpositional input and returns it's node, as a TINT to use as a bit
+    TINT AddInput ();
+
+    // marks a node as an output.  Outputs are kept in the order they are added.
+    void AddOutput (const TINT& node);
+
+    // adds a gate with the nodes A and B as inputs, and returns it's node
+    TINT AddGate (ECircuitNode type, const TINT& A, const TINT& B);
+
+    const std::vector<SCircuitNode>& GetNodes () const { return m_nodes; }
+    const std::vector<uint32_t>& GetOutputs () const { return m_outputs; }
+    size_t GetNumInputs () const { return m_numInputs; }
+    size_t GetNumGates (ECircuitNode type) const;
+    size_t GetNumGates () const { return GetNumGates(ECircuitNode::XOR) + GetNumGates(ECircuitNode::AND); }
+
+    // Simplifies the circuit: folds gates with constant inputs (A XOR 0 = A, A AND 0 = 0,
+    // A AND 1 = A), turns A XOR A into 0, merges gates that do the same thing to the same
+    // inputs, and removes gates no output depends on.  Inputs and outputs stay the same.
+    //
+    // A XOR A is 2A, which decodes to 0 but isn't 0 mod the LCM, so the optimized circuit
+    // decodes to the same values as the original for every key, but its outputs aren't
+    // always equal mod the LCM.
+    void Optimize ();
+
+    bool Write (const char *fileName) const;
+    bool Read (const char *fileName);
+
+    // Writes a standalone cpp file with a function that does the circuit as straight
+    // line code, where every step uses a fixed width integer just big enough for the
+    // value it holds (see CCircuit.cpp).  inputBits is how many bits the inputs have,
+    // which is the bits in the keys LCM.  Values wider than reduceBits (at most twice
+    // inputBits) are reduced mod the LCM, or never if reduceBits is 0.  The function
+    // takes the LCM and its Barrett reciprocal as parameters.
+    bool WriteCpp (const char *fileName, const char *functionName, size_t inputBits, size_t reduceBits) const;
+
+    // Runs the circuit with real superpositional bits, using the same HE operations as
+    // CSuperInt, so outputs match what the recorded math would have given.
+    void Evaluate (const std::vector<TINT>& inputs, const CKeySet& keySet, std::vector<TINT>& outputs) const;
+
+private:
+    uint32_t NodeFromTINT (const TINT& node) const;
+    uint32_t AddNode (ECircuitNode type, uint32_t a, uint32_t b);
+
+private:
+    std::vector<SCircuitNode>   m_nodes;
+    std::vector<uint32_t>       m_outputs;
+    size_t                      m_numInputs;
+};
@@ -0,0 +1,9 @@
+//=================================================================================
+//
+//  CFixedWidthBit
+//
+//  A superpositional bit stored in a fixed width integer
+//
+//=================================================================================
+
+#include "CFixedWidthBit.h"
@@ -0,0 +1,323 @@
+//=================================================================================
+//
+//  CFixedWidthBit
+//
+//  A superpositional bit stored in a fixed width integer of BITS bits, instead of
+//  a TINT, so that gates never allocate memory.  Up to 64 bits it's a uint64_t, up
+//  to 128 bits an unsigned __int128 (or boost's uint128_t where that isn't
+//  available), and above that a fixed width cpp_int that lives on the stack.
+//
+//  Values are always kept reduced mod the keys LCM, whatever the key set's reduce
+//  policy is, so the product of two bits must fit: BITS has to be a little over twice
+//  the number of bits in the LCM (see FixedWidthBitsNeeded()).  DispatchBitStorage()
+//  picks the smallest BITS that works for a key set.
+//
+//  Use it as the bit storage type of a CSuperInt, like CSuperInt<3, CFixedWidthBit<128>>.
+//
+//=================================================================================
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+#include "CKeySet.h"
+#include "TINT.h"
+#include "Macros.h"
+
+//=================================================================================
+// The integer type used to store BITS bits
+//=================================================================================
+template <size_t BITS, bool FITS64 = (BITS <= 64), bool FITS128 = (BITS <= 128)>
+struct SFixedWidthStorage
+{
+    typedef boost::multiprecision::number<
+        boost::multiprecision::cpp_int_backend<
+            BITS, BITS,
+            boost::multiprecision::unsigned_magnitude,
+            boost::multiprecision::unchecked,
+            void
+        >
+    > type;
+};
+
+template <size_t BITS>
+struct SFixedWidthStorage<BITS, true, true>
+{
+    typedef uint64_t type;
+};
+
+template <size_t BITS>
+struct SFixedWidthStorage<BITS, false, true>
+{
+    #if defined(__SIZEOF_INT128__)
+        typedef unsigned __int128 type;
+    #else
+        typedef boost::multiprecision::uint128_t type;
+    #endif
+};
+
+//=================================================================================
+// Conversions between TINT, 64 bit limbs and the storage types
+//=================================================================================
+inline void FixedWidthFromLimbs (const std::vector<uint64_t> &limbs, uint64_t &value)
+{
+    value = limbs.empty() ? 0 : limbs[0];
+}
+
+#if defined(__SIZEOF_INT128__)
+inline void FixedWidthFromLimbs (const std::vector<uint64_t> &limbs, unsigned __int128 &value)
+{
+    value = limbs.empty() ? 0 : limbs[0];
+    if (limbs.size() > 1)
+        value |= ((unsigned __int128)limbs[1]) << 64;
+}
+#endif
+
+template <typename T>
+void FixedWidthFromLimbs (const std::vector<uint64_t> &limbs, T &value)
+{
+    // This is done for every gate, so copy straight into the backend instead of using
+    // import_bits().  Both are little endian, so it works for 32 bit limbs too.
+    typedef boost::multiprecision::limb_type TLimb;
+    const size_t c_numLimbs = limbs.size() * sizeof(uint64_t) / sizeof(TLimb);
+    if (c_numLimbs == 0)
+    {
+        value = 0;
+        return;
+    }
+    value.backend().resize(unsigned(c_numLimbs), unsigned(c_numLimbs));
+    memcpy(value.backend().limbs(), limbs.data(), limbs.size() * sizeof(uint64_t));
+    value.backend().normalize();
+}
+
+//=================================================================================
+inline void FixedWidthFromTINT (const TINT &tint, uint64_t &value)
+{
+    value = tint.convert_to<uint64_t>();
+}
+
+#if defined(__SIZEOF_INT128__)
+inline void FixedWidthFromTINT (const TINT &tint, unsigned __int128 &value)
+{
+    value = ((unsigned __int128)TINT(tint >> 64).convert_to<uint64_t>()) << 64;
+    value |= TINT(tint & UINT64_MAX).convert_to<uint64_t>();
+}
+#endif
+
+template <typename T>
+void FixedWidthFromTINT (const TINT &tint, T &value)
+{
+    value = T(tint);
+}
+
+//=================================================================================
+inline TINT FixedWidthToTINT (uint64_t value)
+{
+    return TINT(value);
+}
+
+#if defined(__SIZEOF_INT128__)
+inline TINT FixedWidthToTINT (unsigned __int128 value)
+{
+    return (TINT(uint64_t(value >> 64)) << 64) | TINT(uint64_t(value));
+}
+#endif
+
+template <typename T>
+TINT FixedWidthToTINT (const T &value)
+{
+    return TINT(value);
+}
+
+//=================================================================================
+// v = v % the keys LCM, for v < LCM^2.  Native types divide, and the fixed width
+// cpp_int types use Barrett reduction (see CBarrettReducer), since their division is slow.
+// A key set without keys has no LCM, and values are left alone.
+//=================================================================================
+inline void FixedWidthReduceProduct (uint64_t &v, const CKeySet &keySet)
+{
+    const std::vector<uint64_t> &lcmLimbs = keySet.GetKeysLCMLimbs();
+    if (!lcmLimbs.empty())
+        v %= lcmLimbs[0];
+}
+
+#if defined(__SIZEOF_INT128__)
+inline void FixedWidthReduceProduct (unsigned __int128 &v, const CKeySet &keySet)
+{
+    if (keySet.GetKeysLCMLimbs().empty())
+        return;
+
+    unsigned __int128 lcm;
+    FixedWidthFromLimbs(keySet.GetKeysLCMLimbs(), lcm);
+    v %= lcm;
+}
+#endif
+
+template <typename T>
+void FixedWidthReduceProduct (T &v, const CKeySet &keySet)
+{
+    if (keySet.GetKeysLCMLimbs().empty())
+        return;
+
+    T lcm;
+    FixedWidthFromLimbs(keySet.GetKeysLCMLimbs(), lcm);
+    if (v < lcm)
+        return;
+
+    T reciprocal;
+    FixedWidthFromLimbs(keySet.GetKeysLCMReciprocalLimbs(), reciprocal);
+    const unsigned c_lcmBits = unsigned(keySet.GetKeysLCMBits());
+    T q = v >> (c_lcmBits - 1);
+    q *= reciprocal;
+    q >>= (c_lcmBits + 1);
+    v -= q * lcm;
+    while (v >= lcm)
+        v -= lcm;
+}
+
+//=================================================================================
+// How many bits CFixedWidthBit needs for a key set: enough for the product of two
+// values less than the LCM, plus 2 for Barrett reduction.
+//=================================================================================
+inline size_t FixedWidthBitsNeeded (const CKeySet &keySet)
+{
+    return keySet.GetKeysLCMBits() * 2 + 2;
+}
+
+//=================================================================================
+template <size_t BITS>
+class CFixedWidthBit
+{
+public:
+    typedef typename SFixedWidthStorage<BITS>::type TStorage;
+
+    // initialize to a non superpositional value
+    CFixedWidthBit (int value = 0) : m_value(TStorage(value)) {}
+
+    const TStorage& GetValue () const { return m_value; }
+    TStorage& GetValue () { return m_value; }
+
+    // the keys LCM, in this bit's storage type
+    static TStorage GetKeysLCM (const CKeySet &keySet)
+    {
+        TStorage lcm;
+        FixedWidthFromLimbs(keySet.GetKeysLCMLimbs(), lcm);
+        return lcm;
+    }
+
+    static const size_t c_numBits = BITS;
+
+private:
+    TStorage    m_value;
+};
+
+//=================================================================================
+// HE operations
+//=================================================================================
+template <size_t BITS>
+void XOREQ (CFixedWidthBit<BITS> &A, const CFixedWidthBit<BITS> &B, const CKeySet &keySet)
+{
+    // both values are less than the LCM, so their sum is less than twice the LCM
+    typedef typename CFixedWidthBit<BITS>::TStorage TStorage;
+    const TStorage lcm = CFixedWidthBit<BITS>::GetKeysLCM(keySet);
+    A.GetValue() += B.GetValue();
+    if (A.GetValue() >= lcm)
+        A.GetValue() -= lcm;
+}
+
+//=================================================================================
+template <size_t BITS>
+CFixedWidthBit<BITS> XOR (const CFixedWidthBit<BITS> &A, const CFixedWidthBit<BITS> &B, const CKeySet &keySet)
+{
+    CFixedWidthBit<BITS> result(A);
+    XOREQ(result, B, keySet);
+    return result;
+}
+
+//=================================================================================
+template <size_t BITS>
+void ANDEQ (CFixedWidthBit<BITS> &A, const CFixedWidthBit<BITS> &B, const CKeySet &keySet)
+{
+    // the product is less than LCM^2, which fits in BITS
+    A.GetValue() *= B.GetValue();
+    FixedWidthReduceProduct(A.GetValue(), keySet);
+}
+
+//=================================================================================
+template <size_t BITS>
+CFixedWidthBit<BITS> AND (const CFixedWidthBit<BITS> &A, const CFixedWidthBit<BITS> &B, const CKeySet &keySet)
+{
+    CFixedWidthBit<BITS> result(A);
+    ANDEQ(result, B, keySet);
+    return result;
+}
+
+//=================================================================================
+template <size_t BITS>
+CFixedWidthBit<BITS> NOT (const CFixedWidthBit<BITS> &A, const CKeySet &keySet)
+{
+    return XOR(A, CFixedWidthBit<BITS>(1), keySet);
+}
+
+//=================================================================================
+// Bit storage interface used by CSuperInt
+//=================================================================================
+template <size_t BITS>
+void BitFromTINT (const TINT &value, const CKeySet &keySet, CFixedWidthBit<BITS> &bit)
+{
+    Assert_(FixedWidthBitsNeeded(keySet) <= BITS);
+    FixedWidthFromTINT(value % keySet.GetKeysLCM(), bit.GetValue());
+}
+
+//=================================================================================
+template <size_t BITS>
+TINT BitToTINT (const CFixedWidthBit<BITS> &bit, const CKeySet &)
+{
+    return FixedWidthToTINT(bit.GetValue());
+}
+
+//=================================================================================
+template <size_t BITS>
+size_t DecodeBit (const CFixedWidthBit<BITS> &bit, const TINT &key, const CKeySet &keySet)
+{
+    TINT value = (BitToTINT(bit, keySet) % key) % 2;
+    return value.convert_to<size_t>();
+}
+
+//=================================================================================
+template <size_t BITS>
+void DecodeBitsAllKeys (const CFixedWidthBit<BITS> *bits, size_t numBits, const CKeySet &keySet, std::vector<std::vector<uint64_t>> &packed)
+{
+    std::vector<TINT> values(numBits);
+    for (size_t i = 0; i < numBits; ++i)
+        values[i] = BitToTINT(bits[i], keySet);
+    keySet.DecodeAllKeys(values, packed);
+}
+
+//=================================================================================
+// Calls functor.Run<TBIT>() with the smallest bit storage type that works for the
+// key set: a CFixedWidthBit if one is big enough, otherwise TINT.  Returns what Run()
+// returns.
+//=================================================================================
+template <typename TFUNCTOR>
+bool DispatchBitStorage (const CKeySet &keySet, TFUNCTOR &functor)
+{
+    const size_t c_productBits = FixedWidthBitsNeeded(keySet);
+    if (c_productBits <= 64)
+        return functor.template Run<CFixedWidthBit<64>>();
+    else if (c_productBits <= 128)
+        return functor.template Run<CFixedWidthBit<128>>();
+    else if (c_productBits <= 256)
+        return functor.template Run<CFixedWidthBit<256>>();
+    else if (c_productBits <= 512)
+        return functor.template Run<CFixedWidthBit<512>>();
+    else if (c_productBits <= 1024)
+        return functor.template Run<CFixedWidthBit<1024>>();
+    else if (c_productBits <= 2048)
+        return functor.template Run<CFixedWidthBit<2048>>();
+    else if (c_productBits <= 4096)
+        return functor.template Run<CFixedWidthBit<4096>>();
+    else
+        return functor.template Run<TINT>();
+}
@@ -7,8 +7,14 @@
 //=================================================================================
 
 #include "CKeySet.h"
+#include "CKeySetFile.h"
+#include "CKeySetCache.h"
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "Macros.h"
 
 //=================================================================================
 static TINT ExtendedEuclidianAlgorithm (TINT smaller, TINT larger, TINT &s, TINT &t)
@@ -45,9 +51,10 @@ static TINT ExtendedEuclidianAlgorithm (TINT smaller, TINT larger, TINT &s, TINT
             if (swapped)
                 std::swap(s, t);
 
-            // if t < 0, add the modulus divisor to it, to make it positive
+            // if t < 0, add the modulus divisor to it, to make it positive.
+            // The divisor is the second parameter, which is "smaller" if we swapped.
             if (t < 0)
-                t += smaller;
+                t += swapped ? smaller : larger;
             return remainders[indexNeg1];
         }
 
@@ -65,9 +72,155 @@ static TINT ExtendedEuclidianAlgorithm (TINT smaller, TINT larger, TINT &s, TINT
     }
 }
 
+//=================================================================================
+// Makes a product tree of the keys.  Level 0 is the keys themselves, every level
+// above that holds the products of pairs of nodes in the level below it, and the
+// last level is a single value: the product of all the keys.
+static void BuildProductTree (const std::vector<TINT> &keys, std::vector<std::vector<TINT>> &tree)
+{
+    tree.clear();
+    tree.push_back(keys);
+    while (tree.back().size() > 1)
+    {
+        const std::vector<TINT> &below = tree.back();
+        std::vector<TINT> level((below.size() + 1) / 2);
+        for (size_t i = 0, c = level.size(); i < c; ++i)
+        {
+            if (i * 2 + 1 < below.size())
+                level[i] = below[i * 2] * below[i * 2 + 1];
+            else
+                level[i] = below[i * 2];
+        }
+        tree.push_back(std::move(level));
+    }
+}
+
+//=================================================================================
+// Uses a remainder tree to calculate value mod key (or key^2 if squared is true) for every
+// key in the product tree.  Going down the tree, each node's remainder comes from the
+// smaller remainder of its parent instead of from the full value.
+static void RemainderTree (const TINT &value, const std::vector<std::vector<TINT>> &tree, std::vector<TINT> &remainders, bool squared)
+{
+    std::vector<TINT> current(1, value);
+    for (size_t level = tree.size() - 1; level > 0; --level)
+    {
+        const std::vector<TINT> &nodes = tree[level - 1];
+        std::vector<TINT> next(nodes.size());
+        for (size_t i = 0, c = nodes.size(); i < c; ++i)
+            next[i] = current[i / 2] % (squared ? nodes[i] * nodes[i] : nodes[i]);
+        current.swap(next);
+    }
+
+    // with a single key, the loop above doesn't do anything
+    if (tree.size() == 1)
+        current[0] = value % (squared ? tree[0][0] * tree[0][0] : tree[0][0]);
+    remainders.swap(current);
+}
+
+//=================================================================================
+// Calls leaf(leafIndex, coefficient) for the leaves in [begin, end) under a node of the
+// product tree, where coefficient is the product of all of the keys except that leaf's.
+// nodeCoefficient is that product for the node.  A child's coefficient is its parent's
+// times its sibling, which is a smaller multiply than dividing the product by the child.
+static void DescendProductTree (
+    const std::vector<std::vector<TINT>> &tree,
+    size_t level,
+    size_t index,
+    const TINT &nodeCoefficient,
+    size_t begin,
+    size_t end,
+    const std::function<void (size_t leafIndex, const TINT &coefficient)> &leaf
+)
+{
+    if (level == 0)
+    {
+        leaf(index, nodeCoefficient);
+        return;
+    }
+
+    const std::vector<TINT> &children = tree[level - 1];
+    for (size_t child = index * 2; child < index * 2 + 2 && child < children.size(); ++child)
+    {
+        // skip children with no leaves in range
+        if (((child + 1) << (level - 1)) <= begin || (child << (level - 1)) >= end)
+            continue;
+
+        const size_t sibling = child ^ 1;
+        if (sibling < children.size())
+            DescendProductTree(tree, level - 1, child, nodeCoefficient * children[sibling], begin, end, leaf);
+        else
+            DescendProductTree(tree, level - 1, child, nodeCoefficient, begin, end, leaf);
+    }
+}
+
+//=================================================================================
+// Calls work(index) for every index in [0, count), spread across numThreads threads, or
+// all hardware threads if numThreads is 0.  progress(done, count) is only called on the
+// calling thread, so it doesn't need to be thread safe.
+static void ParallelFor (size_t numThreads, size_t count, const std::function<void (size_t index)> &work, const std::function<void (size_t done, size_t count)> &progress)
+{
+    std::atomic<size_t> nextIndex(0);
+    std::atomic<size_t> doneCount(0);
+    auto worker = [&nextIndex, &doneCount, &work, count] ()
+    {
+        for (size_t index = nextIndex++; index < count; index = nextIndex++)
+        {
+            work(index);
+            ++doneCount;
+        }
+    };
+
+    if (numThreads == 0)
+        numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    numThreads = std::min<size_t>(numThreads, count);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; ++i)
+        threads.push_back(std::thread(worker));
+
+    // the calling thread works too, and reports progress
+    for (size_t index = nextIndex++; index < count; index = nextIndex++)
+    {
+        work(index);
+        progress(++doneCount, count);
+    }
+
+    for (std::thread &thread : threads)
+        thread.join();
+}
+
+//=================================================================================
+// Adds the odd primes up to and including limit to primes, using a sieve of
+// Eratosthenes.  composite holds the sieve between calls, and grows by at least
+// double each time it needs to be redone.
+static void ExtendPrimes (std::vector<bool> &composite, std::vector<uint64_t> &primes, uint64_t limit)
+{
+    if (limit < composite.size())
+        return;
+
+    const size_t c_sieveSize = size_t(std::max<uint64_t>(limit + 1, composite.size() * 2));
+    composite.assign(c_sieveSize, false);
+    for (size_t i = 3; i * i < c_sieveSize; i += 2)
+    {
+        if (composite[i])
+            continue;
+        for (size_t j = i * i; j < c_sieveSize; j += 2 * i)
+            composite[j] = true;
+    }
+
+    for (size_t i = primes.empty() ? 3 : size_t(primes.back()) + 2; i <= limit; i += 2)
+    {
+        if (!composite[i])
+            primes.push_back(i);
+    }
+}
+
 //=================================================================================
 bool CKeySet::Read (const char *fileName)
 {
+    // binary key set files are detected by their header
+    if (CKeySetFile::IsKeySetFile(fileName))
+        return ReadBinary(fileName);
+
     std::ifstream file;
     file.open(fileName);
 
@@ -85,6 +238,7 @@ bool CKeySet::Read (const char *fileName)
         // resize the data arrays
         m_superPositionedBits.resize(numBits);
         m_keys.resize(1 << numBits);
+        m_crtBasis.clear();
 
         // read the bits
         for (TINT &v : m_superPositionedBits)
@@ -99,15 +253,77 @@ bool CKeySet::Read (const char *fileName)
     bool ret = !file.fail();
     file.close();
 
+    // don't leave a partly read key set behind
+    if (!ret)
+    {
+        m_superPositionedBits.clear();
+        m_keys.clear();
+        m_crtBasis.clear();
+    }
+
+    OnKeysRead();
+    return ret;
+}
+
+//=================================================================================
+bool CKeySet::ReadBinary (const char *fileName)
+{
+    CKeySetFile file;
+    if (!file.Open(fileName))
+        return false;
+
+    m_superPositionedBits.resize(file.GetNumBits());
+    m_keys.resize(file.GetNumKeys());
+    m_crtBasis.clear();
+
+    for (size_t i = 0, c = m_superPositionedBits.size(); i < c; ++i)
+        m_superPositionedBits[i] = file.GetBit(i);
+
+    const TINT firstKey = file.GetFirstKey();
+    for (size_t i = 0, c = m_keys.size(); i < c; ++i)
+        m_keys[i] = firstKey + file.GetKeyOffset(i);
+
+    OnKeysRead();
+    return true;
+}
+
+//=================================================================================
+void CKeySet::OnKeysRead ()
+{
     // calculate keys LCM
-    m_keysLCM = 1;
-    for (const TINT& v : m_keys)
-        m_keysLCM *= v;
+    if (m_keys.empty())
+    {
+        m_keysLCM = 1;
+    }
+    else
+    {
+        std::vector<std::vector<TINT>> productTree;
+        BuildProductTree(m_keys, productTree);
+        m_keysLCM = productTree.back()[0];
+    }
 
-    // we will reduce numbers since we have an LCM
-    m_reduce = true;
+    OnKeysLCMChanged();
 
-    return ret;
+    CalculateRNSKeys();
+}
+
+//=================================================================================
+void CKeySet::OnKeysLCMChanged ()
+{
+    // we will reduce numbers if we have an LCM.  There isn't one without keys, or if a
+    // key file held zeros.
+    m_reduce = m_keysLCM > 1;
+    if (!m_reduce)
+    {
+        m_reducer = CBarrettReducer();
+        m_keysLCMLimbs.clear();
+        m_keysLCMReciprocalLimbs.clear();
+        return;
+    }
+    m_reducer.SetModulus(m_keysLCM);
+
+    TINTToLimbs(m_keysLCM, m_keysLCMLimbs);
+    TINTToLimbs(m_reducer.GetReciprocal(), m_keysLCMReciprocalLimbs);
 }
 
 //=================================================================================
@@ -134,23 +350,48 @@ bool CKeySet::Write (const char *fileName) const
     return true;
 }
 
+//=================================================================================
+bool CKeySet::WriteBinary (const char *fileName) const
+{
+    return CKeySetFile::Write(fileName, m_superPositionedBits, m_keys);
+}
+
 //=================================================================================
 void CKeySet::CalculateCached (int numBits, const TINT& minKey, const std::function<void (uint8_t percent)>& progressCallback)
 {
-    // if we can read the keys from the cache do that and return
-    std::stringstream fileName;
-    fileName << "keys_" << numBits << "_" << minKey << ".txt";
-    if (Read(fileName.str().c_str()))
+    // use the smallest cached key set whose keys are all at least minKey
+    CKeySetCache cache(m_cacheDirectory);
+    std::string fileName;
+    if (cache.Find(numBits, minKey, fileName) && Read(fileName.c_str()) && m_superPositionedBits.size() == size_t(numBits))
     {
         progressCallback(100);
         return;
     }
 
+    // key files from before there was an index are only found by their exact name.
+    // Index them so they can be used for other bounds too.
+    std::stringstream legacyFileName;
+    legacyFileName << "keys_" << numBits << "_" << minKey << ".txt";
+    if (Read(cache.GetPath(legacyFileName.str()).c_str()))
+    {
+        cache.AddToIndex(numBits, minKey, legacyFileName.str());
+        progressCallback(100);
+        return;
+    }
+
+    // else extend a cached key set that has fewer bits, if there is one
+    TINT smallerMinKey;
+    if (cache.FindToExtend(numBits, minKey, fileName, smallerMinKey) && Read(fileName.c_str()) && Extend(numBits, progressCallback))
+    {
+        cache.Store(*this, numBits, smallerMinKey);
+        return;
+    }
+
     // Do the calculation
     Calculate(numBits, minKey, progressCallback);
 
     // write these keys to the cache
-    Write(fileName.str().c_str());
+    cache.Store(*this, numBits, minKey);
 }
 
 //=================================================================================
@@ -159,6 +400,7 @@ void CKeySet::Calculate (int numBits, const TINT& minKey, const std::function<vo
     // size our arrays
     m_superPositionedBits.resize(size_t(numBits));
     m_keys.resize(size_t(1) << m_superPositionedBits.size());
+    m_crtBasis.clear();
 
     // set our keys to co prime numbers that aren't super tiny.  The smallest key
     // determines how much error we can tolerate building up, just like FHE over integers.
@@ -167,108 +409,638 @@ void CKeySet::Calculate (int numBits, const TINT& minKey, const std::function<vo
     TINT isOdd = m_keys[0] % 2;
     if (isOdd == 0)
         m_keys[0]++;
-    m_keysLCM = m_keys[0];
-    for (size_t i = 1, c = m_keys.size(); i < c; ++i)
+    MakeKeys(
+        0,
+        [&lastPercent, &progressCallback] (size_t done, size_t count)
+        {
+            uint8_t percent = uint8_t(done * 33 / count);
+            if (lastPercent != percent)
+            {
+                progressCallback(percent);
+                lastPercent = percent;
+            }
+        }
+    );
+
+    // The keys are co-prime so their LCM is their product, which is the root of the
+    // product tree.  The CRT needs LCM mod key^2 for each key, from a remainder tree, and
+    // the basis values are made going back down the product tree.
+    std::vector<std::vector<TINT>> productTree;
+    BuildProductTree(m_keys, productTree);
+    m_keysLCM = productTree.back()[0];
+    std::vector<TINT> remainders;
+    RemainderTree(m_keysLCM, productTree, remainders, true);
+
+    // calculate the chinese remainder theorem basis and each x value from it
+    CalculateBits(
+        0,
+        m_keysLCM,
+        productTree,
+        remainders,
+        m_superPositionedBits,
+        m_crtBasis,
+        [&lastPercent, &progressCallback] (size_t done, size_t count)
+        {
+            uint8_t percent = uint8_t(done * 66 / count + 33);
+            if (lastPercent != percent)
+            {
+                progressCallback(percent);
+                lastPercent = percent;
+            }
+        }
+    );
+
+    progressCallback(100);
+
+    OnKeysLCMChanged();
+
+    CalculateRNSKeys();
+}
+
+//=================================================================================
+bool CKeySet::Extend (int numBits, const std::function<void (uint8_t percent)>& progressCallback)
+{
+    // The keys for n bits are the first 2^n keys for n+1 bits, so extending a key set only
+    // needs the new keys.  The new keys get their basis values and their part of each bit
+    // the same way Calculate() does it, against the new LCM.  The sum of the new basis
+    // values is 1 mod every new key and 0 mod every old key, so one minus that, eA, is
+    // the other way around.  Multiplying an old bit by eA turns it into one for the new
+    // LCM, which is 0 mod all of the new keys, and then the new keys' part is added.
+    //
+    // The old basis values could be updated the same way, but a multiply and mod by the
+    // new LCM for each of them costs more than making them again, so they are dropped
+    // and GetCRTBasis() makes them again if they are needed.
+    const size_t c_oldNumBits = m_superPositionedBits.size();
+    const size_t c_oldNumKeys = m_keys.size();
+    if (numBits < 0 || size_t(numBits) < c_oldNumBits || c_oldNumKeys == 0)
+        return false;
+    if (size_t(numBits) == c_oldNumBits)
     {
-        MakeKey(i);
-        m_keysLCM *= m_keys[i];
-        uint8_t percent = i * 33 / c;
-        if (lastPercent != percent)
+        progressCallback(100);
+        return true;
+    }
+
+    m_crtBasis.clear();
+
+    // make the new keys
+    uint8_t lastPercent = 255;
+    m_keys.resize(size_t(1) << size_t(numBits));
+    bool keysOK = MakeKeys(
+        c_oldNumKeys,
+        [&lastPercent, &progressCallback] (size_t done, size_t count)
         {
-            progressCallback(percent);
-            lastPercent = percent;
+            uint8_t percent = uint8_t(done * 33 / count);
+            if (lastPercent != percent)
+            {
+                progressCallback(percent);
+                lastPercent = percent;
+            }
         }
+    );
+    if (!keysOK)
+    {
+        m_keys.resize(c_oldNumKeys);
+        return false;
+    }
+
+    // The new LCM, and the new LCM mod key^2 for each new key
+    std::vector<std::vector<TINT>> productTree;
+    {
+        std::vector<TINT> newKeys(m_keys.begin() + c_oldNumKeys, m_keys.end());
+        BuildProductTree(newKeys, productTree);
     }
+    m_keysLCM *= productTree.back()[0];
+    std::vector<TINT> remainders;
+    RemainderTree(m_keysLCM, productTree, remainders, true);
+
+    // calculate the new keys' part of each bit
+    std::vector<TINT> newBits(size_t(numBits), 0);
+    std::vector<TINT> newBasis;
+    TINT newBasisSum;
+    CalculateBits(
+        c_oldNumKeys,
+        m_keysLCM,
+        productTree,
+        remainders,
+        newBits,
+        newBasis,
+        [&lastPercent, &progressCallback] (size_t done, size_t count)
+        {
+            uint8_t percent = uint8_t(done * 66 / count + 33);
+            if (lastPercent != percent)
+            {
+                progressCallback(percent);
+                lastPercent = percent;
+            }
+        },
+        &newBasisSum
+    );
+    const TINT oldPart = (m_keysLCM + 1 - newBasisSum) % m_keysLCM;
+
+    // combine the old and new parts of the bits
+    m_superPositionedBits.resize(size_t(numBits), 0);
+    ParallelFor(
+        m_numThreads,
+        m_superPositionedBits.size(),
+        [&] (size_t bitIndex)
+        {
+            TINT &bit = m_superPositionedBits[bitIndex];
+            bit = (bit * oldPart + newBits[bitIndex]) % m_keysLCM;
+        },
+        [] (size_t, size_t) {}
+    );
+
+    progressCallback(100);
 
-    // calculate our co-efficients for each term, for the chinese remainder theorem.
-    // We do it here because it can be re-used for each x value we are solving for
-    // with these keys.
+    OnKeysLCMChanged();
+
+    CalculateRNSKeys();
+    return true;
+}
+
+//=================================================================================
+bool CKeySet::MakeKeys (size_t firstNewKey, const std::function<void (size_t done, size_t count)> &progress)
+{
+    // Each key is the smallest odd number after the previous key that is co-prime to all
+    // of the keys before it.  Instead of doing a gcd against every previous key for each
+    // candidate, we sieve the candidates in segments, by their offset from the first key.
+    //
+    // If a candidate and an earlier key share a prime factor p, p also divides their
+    // difference, so only primes smaller than the span of the keys can ever matter.
+    // firstKey mod p tells us which offsets are multiples of p.  Once a key is found that
+    // is a multiple of p, p is used up, and every later offset that is a multiple of p is
+    // rejected.  Besides firstKey mod p, everything here is done with machine words.
+    //
+    // Keys before firstNewKey already exist.  They are sieved again to find which primes
+    // they use, and must be exactly the keys the sieve would have picked.  Returns false
+    // if they aren't.
+    static const size_t c_segmentSize = 1 << 15;
+    const TINT firstKey = m_keys[0];
     const size_t c_numKeys = m_keys.size();
-    std::vector<TINT> coefficients;
-    coefficients.resize(c_numKeys);
-    fill(coefficients.begin(), coefficients.end(), 1);
-    for (size_t i = 0; i < c_numKeys; ++i)
+
+    std::vector<uint64_t> primes;
+    std::vector<uint64_t> primeMultiples;  // the first even offset that is a multiple of the prime
+    std::vector<bool> primeUsed;           // true if a key is a multiple of the prime
+    std::vector<uint64_t> keyOffsets(firstNewKey);
+    std::vector<bool> composite;
+    for (size_t i = 0; i < firstNewKey; ++i)
     {
-        for (size_t j = 0; j < c_numKeys; ++j)
+        TINT offset = m_keys[i] - firstKey;
+        keyOffsets[i] = offset.convert_to<uint64_t>();
+    }
+
+    // per segment storage.  The primes dividing each candidate are kept as linked lists
+    // in flat arrays.
+    std::vector<char> rejected(c_segmentSize);
+    std::vector<int32_t> firstFactor(c_segmentSize);
+    std::vector<int32_t> nextFactor;
+    std::vector<uint32_t> factorPrime;
+
+    size_t keyIndex = 0;
+    size_t existingIndex = 0;
+    for (uint64_t segmentStart = 0; keyIndex < c_numKeys; segmentStart += 2 * c_segmentSize)
+    {
+        const uint64_t segmentEnd = segmentStart + 2 * c_segmentSize;
+
+        // add the odd primes up to the end of this segment.  A new prime is larger than every
+        // offset so far, so it's only used if the one offset that is a multiple of it is a key.
+        // The bigint mods are the only expensive part of making keys, so they are threaded.
+        const size_t firstNewPrime = primes.size();
+        ExtendPrimes(composite, primes, segmentEnd);
+        primeMultiples.resize(primes.size());
+        ParallelFor(
+            m_numThreads,
+            primes.size() - firstNewPrime,
+            [&] (size_t index)
+            {
+                const uint64_t prime = primes[firstNewPrime + index];
+                TINT firstKeyModPrime = firstKey % prime;
+                uint64_t multiple = (prime - firstKeyModPrime.convert_to<uint64_t>()) % prime;
+                if (multiple % 2 != 0)
+                    multiple += prime;
+                primeMultiples[firstNewPrime + index] = multiple;
+            },
+            [] (size_t, size_t) {}
+        );
+        for (size_t i = firstNewPrime, c = primes.size(); i < c; ++i)
         {
-            if (i != j)
-                coefficients[i] *= m_keys[j];
+            const uint64_t multiple = primeMultiples[i];
+            primeUsed.push_back(multiple < segmentStart && std::binary_search(keyOffsets.begin(), keyOffsets.end(), multiple));
         }
-        uint8_t percent = i * 33 / c_numKeys + 33;
-        if (lastPercent != percent)
+
+        // sieve the segment.  Even offsets that are multiples of a prime are 2*prime apart,
+        // so prime candidates apart.
+        std::fill(rejected.begin(), rejected.end(), 0);
+        std::fill(firstFactor.begin(), firstFactor.end(), -1);
+        nextFactor.clear();
+        factorPrime.clear();
+        for (size_t i = 0, c = primes.size(); i < c; ++i)
         {
-            progressCallback(percent);
-            lastPercent = percent;
+            const uint64_t prime = primes[i];
+            const uint64_t period = 2 * prime;
+            uint64_t first = (primeMultiples[i] + period - segmentStart % period) % period;
+            for (size_t index = size_t(first / 2); index < c_segmentSize; index += size_t(prime))
+            {
+                if (primeUsed[i])
+                {
+                    rejected[index] = 1;
+                }
+                else
+                {
+                    nextFactor.push_back(firstFactor[index]);
+                    factorPrime.push_back(uint32_t(i));
+                    firstFactor[index] = int32_t(nextFactor.size() - 1);
+                }
+            }
         }
-    }
 
-    // calculate each x value
-    for (size_t i = 0, c = m_superPositionedBits.size(); i < c; ++i)
-    {
-        m_superPositionedBits[i] = CalculateBit(i, coefficients);
-        uint8_t percent = i * 33 / c + 66;
-        if (lastPercent != percent)
+        // walk the candidates in order.  Each one that isn't rejected is our next key, and
+        // the primes that divide it become used.
+        for (size_t index = 0; index < c_segmentSize && keyIndex < c_numKeys; ++index)
         {
-            progressCallback(percent);
-            lastPercent = percent;
+            const uint64_t offset = segmentStart + 2 * index;
+            const bool existing = existingIndex < firstNewKey && keyOffsets[existingIndex] == offset;
+            if (existingIndex < firstNewKey && rejected[index] == existing)
+                return false;
+
+            if (rejected[index])
+                continue;
+
+            if (existing)
+            {
+                ++existingIndex;
+            }
+            else
+            {
+                m_keys[keyIndex] = firstKey + offset;
+                keyOffsets.push_back(offset);
+            }
+            ++keyIndex;
+            if (keyIndex > firstNewKey)
+                progress(keyIndex - firstNewKey, c_numKeys - firstNewKey);
+
+            for (int32_t factor = firstFactor[index]; factor >= 0; factor = nextFactor[factor])
+            {
+                const uint32_t primeIndex = factorPrime[factor];
+                if (primeUsed[primeIndex])
+                    continue;
+                primeUsed[primeIndex] = true;
+                for (size_t later = index + size_t(primes[primeIndex]); later < c_segmentSize; later += size_t(primes[primeIndex]))
+                    rejected[later] = 1;
+            }
         }
     }
+    return true;
+}
 
-    progressCallback(100);
+//=================================================================================
+void CKeySet::CalculateCRTBasis (size_t firstKey, const TINT &lcm, const std::vector<std::vector<TINT>> &productTree, const std::vector<TINT> &remainders, size_t begin, size_t end, std::vector<TINT> &basis, const std::function<void (size_t done, size_t count)> &progress) const
+{
+    // For the chinese remainder theorem, each key has a coefficient which is the product
+    // of all other keys: LCM / key.  We need the modular multiplicative inverse of each
+    // coefficient, mod the key, but only need the coefficient mod the key to get that.
+    // (LCM mod key^2) / key is the coefficient mod key, and a remainder tree gets us
+    // LCM mod key^2 for all keys without ever making the full coefficients.
+    //
+    // The basis value for each key is then coefficient * inverse, which is 1 mod that
+    // key and 0 mod every other key.  The full coefficients come from going down the
+    // product tree (see DescendProductTree).  The keys are split into blocks, which are
+    // subtrees of the product tree.  A block's coefficient is one division of the LCM,
+    // and the blocks are done in parallel.
+    //
+    // This works on the keys from firstKey onwards, whose LCM is lcm.  productTree is
+    // the product tree of those keys, and remainders holds lcm mod key^2 for them.  It
+    // calculates the basis values for keys [begin, end) into basis[0, end - begin).
+    static const size_t c_maxBlockLevel = 6;
+    static const size_t c_minBlocks = 16;
+    size_t blockLevel = std::min(c_maxBlockLevel, productTree.size() - 1);
+    while (blockLevel > 0 && productTree[blockLevel].size() < c_minBlocks)
+        --blockLevel;
+
+    const size_t c_leafBegin = begin - firstKey;
+    const size_t c_leafEnd = end - firstKey;
+    const size_t c_firstBlock = c_leafBegin >> blockLevel;
+    const size_t c_numBlocks = ((c_leafEnd - 1) >> blockLevel) - c_firstBlock + 1;
 
-    // we will reduce numbers since we have an LCM
-    m_reduce = true;
+    basis.resize(end - begin);
+    ParallelFor(
+        m_numThreads,
+        c_numBlocks,
+        [&] (size_t index)
+        {
+            const size_t block = c_firstBlock + index;
+            DescendProductTree(
+                productTree,
+                blockLevel,
+                block,
+                lcm / productTree[blockLevel][block],
+                c_leafBegin,
+                c_leafEnd,
+                [&] (size_t leafIndex, const TINT &coefficient)
+                {
+                    const size_t i = firstKey + leafIndex;
+                    TINT coefficientModKey = remainders[leafIndex] / m_keys[i];
+                    TINT s, t;
+                    if (m_keys[i] > 1)
+                        ExtendedEuclidianAlgorithm(coefficientModKey, m_keys[i], s, t);
+                    else
+                        t = 0;
+                    basis[i - begin] = coefficient * t;
+                }
+            );
+        },
+        [&progress, begin, end] (size_t done, size_t count) { progress(done * (end - begin) / count, end - begin); }
+    );
 }
 
 //=================================================================================
-void CKeySet::MakeKey (size_t keyIndex)
+const std::vector<TINT> &CKeySet::GetCRTBasis () const
 {
-    // make sure our keys are odd
-    TINT nextNumber = m_keys[keyIndex - 1] + 2;
-    while (1)
+    // The basis is calculated on demand for key sets that were read from disk, or that
+    // were too large to keep the basis for under the memory limit.  It's cached on the
+    // key set, so it's allocated from the heap even if this is called inside of a
+    // CTINTArenaScope.  Worker threads don't have an arena.
+    std::lock_guard<std::mutex> lock(m_crtBasisMutex);
+    if (m_crtBasis.size() != m_keys.size())
     {
-        if (KeyIsCoprime(keyIndex, nextNumber))
-        {
-            m_keys[keyIndex] = nextNumber;
-            return;
-        }
+        CTINTArena* arena = CTINTArena::GetCurrent();
+        CTINTArena::SetCurrent(nullptr);
+
+        std::vector<std::vector<TINT>> productTree;
+        BuildProductTree(m_keys, productTree);
+        std::vector<TINT> remainders;
+        RemainderTree(m_keysLCM, productTree, remainders, true);
+        CalculateCRTBasis(0, m_keysLCM, productTree, remainders, 0, m_keys.size(), m_crtBasis, [] (size_t, size_t) {});
 
-        nextNumber += 2;
+        CTINTArena::SetCurrent(arena);
     }
+    return m_crtBasis;
 }
 
 //=================================================================================
-bool CKeySet::KeyIsCoprime (size_t keyIndex, TINT& value) const
+TINT CKeySet::CalculateValueFromMask (const std::function<bool (size_t keyIndex)> &keyHasBit) const
 {
-    for (size_t index = 0; index < keyIndex; ++index)
+    // a value which is 1 mod every key in the mask, and 0 mod every other key
+    const std::vector<TINT> &basis = GetCRTBasis();
+    TINT ret = 0;
+    for (size_t i = 0, c = m_keys.size(); i < c; ++i)
     {
-        TINT s, t;
-        TINT gcd = ExtendedEuclidianAlgorithm(value, m_keys[index], s, t);
-        if (gcd != 1)
-            return false;
+        if (keyHasBit(i))
+            ret += basis[i];
     }
+    return ret % m_keysLCM;
+}
 
-    return true;
+//=================================================================================
+void CKeySet::CalculateBits (size_t firstKey, const TINT &lcm, const std::vector<std::vector<TINT>> &productTree, const std::vector<TINT> &remainders, std::vector<TINT> &bits, std::vector<TINT> &basis, const std::function<void (size_t done, size_t count)> &progress, TINT *basisSum)
+{
+    // Bit b is the sum of the basis values of every key whose index has bit b set.
+    // Instead of summing half of the basis values for each bit, we split the key index
+    // into its low bits and its high bits.  The sum of each group of keys sharing the
+    // same high bits is shared by every high bit, and the sum of each group of keys
+    // sharing the same low bits is shared by every low bit.  That makes it about 2
+    // passes over the basis values, plus a little work per bit.
+    //
+    // The basis values are the biggest use of memory, at key count * LCM size.  If they
+    // don't fit in the memory limit, they are calculated and summed a chunk of keys at
+    // a time, and aren't kept.
+    //
+    // Only the keys from firstKey onwards are included, using lcm as their LCM (see
+    // CalculateCRTBasis).  The basis values for those keys are put in basis if they are
+    // kept, else basis is left empty.  If basisSum isn't null, it gets the sum of all of
+    // the basis values mod lcm.
+    const size_t c_numKeys = m_keys.size();
+    const size_t c_numBits = bits.size();
+    const size_t c_numLowBits = c_numBits / 2;
+    const size_t c_lowCount = size_t(1) << c_numLowBits;
+    const size_t c_highCount = c_numKeys >> c_numLowBits;
+
+    // work out how many keys to do at once
+    const size_t c_numNewKeys = c_numKeys - firstKey;
+    const size_t c_valueBytes = size_t(boost::multiprecision::msb(lcm) / 8) + sizeof(TINT);
+    const size_t c_sumsBytes = (c_lowCount + c_highCount + c_numBits) * c_valueBytes;
+    size_t chunkSize = c_numNewKeys;
+    if (m_memoryLimit != 0 && c_sumsBytes + c_numNewKeys * c_valueBytes > m_memoryLimit)
+        chunkSize = std::max<size_t>((m_memoryLimit > c_sumsBytes ? m_memoryLimit - c_sumsBytes : 0) / c_valueBytes, 1);
+    const bool c_keepBasis = chunkSize == c_numNewKeys;
+
+    // progress counts a basis value and a sum for each key, and a sum for each bit
+    const size_t c_progressCount = c_numNewKeys * 2 + c_numBits;
+    size_t progressDone = 0;
+
+    std::vector<TINT> lowSums(c_lowCount);
+    std::vector<TINT> highSums(c_highCount);
+    std::vector<TINT> chunkBasis;
+    for (size_t begin = firstKey; begin < c_numKeys; begin += chunkSize)
+    {
+        const size_t end = std::min(begin + chunkSize, c_numKeys);
+        std::vector<TINT> &chunk = c_keepBasis ? basis : chunkBasis;
+        CalculateCRTBasis(
+            firstKey,
+            lcm,
+            productTree,
+            remainders,
+            begin,
+            end,
+            chunk,
+            [&progress, progressDone, c_progressCount] (size_t done, size_t) { progress(progressDone + done, c_progressCount); }
+        );
+        progressDone += end - begin;
+
+        // add this chunk's basis values into the group sums.  Each task owns one sum.
+        const size_t c_firstHigh = begin >> c_numLowBits;
+        const size_t c_highsInChunk = ((end - 1) >> c_numLowBits) - c_firstHigh + 1;
+        ParallelFor(
+            m_numThreads,
+            c_lowCount + c_highsInChunk,
+            [&] (size_t index)
+            {
+                TINT sum = 0;
+                if (index < c_lowCount)
+                {
+                    for (size_t high = c_firstHigh; high < c_firstHigh + c_highsInChunk; ++high)
+                    {
+                        const size_t keyIndex = (high << c_numLowBits) | index;
+                        if (keyIndex >= begin && keyIndex < end)
+                            sum += chunk[keyIndex - begin];
+                    }
+                    lowSums[index] += sum;
+                }
+                else
+                {
+                    const size_t high = c_firstHigh + index - c_lowCount;
+                    for (size_t low = 0; low < c_lowCount; ++low)
+                    {
+                        const size_t keyIndex = (high << c_numLowBits) | low;
+                        if (keyIndex >= begin && keyIndex < end)
+                            sum += chunk[keyIndex - begin];
+                    }
+                    highSums[high] += sum;
+                }
+            },
+            [&progress, progressDone, begin, end, c_progressCount] (size_t done, size_t count) { progress(progressDone + done * (end - begin) / count, c_progressCount); }
+        );
+        progressDone += end - begin;
+    }
+    if (!c_keepBasis)
+        basis.clear();
+
+    // every key is in exactly one low group
+    if (basisSum != nullptr)
+    {
+        *basisSum = 0;
+        for (const TINT &sum : lowSums)
+            *basisSum += sum;
+        *basisSum %= lcm;
+    }
+
+    ParallelFor(
+        m_numThreads,
+        c_numBits,
+        [&] (size_t bitIndex)
+        {
+            const std::vector<TINT> &sums = bitIndex < c_numLowBits ? lowSums : highSums;
+            const size_t bitMask = size_t(1) << (bitIndex < c_numLowBits ? bitIndex : bitIndex - c_numLowBits);
+            TINT sum = 0;
+            for (size_t i = 0, c = sums.size(); i < c; ++i)
+            {
+                if ((i & bitMask) != 0)
+                    sum += sums[i];
+            }
+            bits[bitIndex] = sum % lcm;
+        },
+        [&progress, progressDone, c_progressCount] (size_t done, size_t) { progress(progressDone + done, c_progressCount); }
+    );
 }
 
 //=================================================================================
-TINT CKeySet::CalculateBit (size_t bitIndex, const std::vector<TINT> &coefficients) const
+size_t CKeySet::GetKeyIndex (const TINT& key) const
 {
-    TINT ret = 0;
-    const TINT bitMask = 1 << bitIndex;
+    // keys are made in increasing order, so we can binary search for them
+    std::vector<TINT>::const_iterator it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+    Assert_(it != m_keys.end() && *it == key);
+    return size_t(it - m_keys.begin());
+}
 
-    // now figure out how much to multiply each coefficient by to make it have the specified modulus residue (remainder)
+//=================================================================================
+TINT CKeySet::ReconstructFromResidues (const std::vector<uint64_t> &residues) const
+{
+    // chinese remainder theorem: x = sum(residue[i] * basis[i]) mod LCM
+    Assert_(residues.size() == m_keys.size());
+    const std::vector<TINT> &basis = GetCRTBasis();
+    TINT ret = 0;
     for (size_t i = 0, c = m_keys.size(); i < c; ++i)
     {
-        // we either want this term to be 0 or 1 mod the key.  if zero, we can multiply by zero, and
-        // not add anything into the bit value!
-        if ((i & bitMask) == 0)
-            continue;
+        if (residues[i] != 0)
+            ret += basis[i] * residues[i];
+    }
+    return ret % m_keysLCM;
+}
+
+//=================================================================================
+void CKeySet::DecodeAllKeys (const std::vector<TINT> &values, std::vector<std::vector<uint64_t>> &packed) const
+{
+    // Decoding a value for a key is (value % key) % 2, and doing that for one key at a time
+    // is a full bigint division per key.  If the keys fit in a limb, each value's limbs are
+    // scanned once per key using machine word math instead.  Otherwise a remainder tree
+    // takes the value down the product tree of the keys, so each division is against a
+    // node only as big as it needs to be.
+    #if TINT_BACKEND == TINT_BACKEND_CPP_INT
+        typedef boost::multiprecision::limb_type TLimb;
+        typedef boost::multiprecision::double_limb_type TDoubleLimb;
+    #else
+        // other backends are copied out as 64 bit limbs, which are scanned as 32 bit halves
+        typedef uint32_t TLimb;
+        typedef uint64_t TDoubleLimb;
+    #endif
+    static const size_t c_limbBits = sizeof(TLimb) * 8;
+    static const TINT c_maxLimbKey = TINT(TLimb(~TLimb(0)));
+
+    const size_t c_numKeys = m_keys.size();
+    const size_t c_numWords = (c_numKeys + 63) / 64;
+    packed.assign(values.size(), std::vector<uint64_t>(c_numWords, 0));
+    if (c_numKeys == 0)
+        return;
+
+    if (m_keys.back() <= c_maxLimbKey)
+    {
+        std::vector<TLimb> keys(c_numKeys);
+        for (size_t i = 0; i < c_numKeys; ++i)
+            keys[i] = m_keys[i].convert_to<TLimb>();
+
+        // each task does 64 keys of one value, so writes a single word
+        ParallelFor(
+            m_numThreads,
+            values.size() * c_numWords,
+            [&] (size_t index)
+            {
+                const size_t valueIndex = index / c_numWords;
+                const size_t wordIndex = index % c_numWords;
+                const TINT &value = values[valueIndex];
+                Assert_(value >= 0);
+                #if TINT_BACKEND == TINT_BACKEND_CPP_INT
+                    const TLimb *limbs = value.backend().limbs();
+                    const size_t c_numLimbs = value.backend().size();
+                #else
+                    std::vector<uint64_t> valueLimbs;
+                    TINTToLimbs(value, valueLimbs);
+                    const TLimb *limbs = (const TLimb*)valueLimbs.data();
+                    const size_t c_numLimbs = valueLimbs.size() * 2;
+                #endif
 
-        TINT s, t;
-        ExtendedEuclidianAlgorithm(coefficients[i], m_keys[i], s, t);
-        ret = (ret + ((coefficients[i] * t) % m_keysLCM)) % m_keysLCM;
+                uint64_t word = 0;
+                for (size_t keyIndex = wordIndex * 64, keyEnd = std::min(keyIndex + 64, c_numKeys); keyIndex < keyEnd; ++keyIndex)
+                {
+                    const TLimb key = keys[keyIndex];
+                    TLimb remainder = 0;
+                    for (size_t limbIndex = c_numLimbs; limbIndex > 0; --limbIndex)
+                        remainder = TLimb(((TDoubleLimb(remainder) << c_limbBits) | limbs[limbIndex - 1]) % key);
+                    word |= uint64_t(remainder & 1) << (keyIndex % 64);
+                }
+                packed[valueIndex][wordIndex] = word;
+            },
+            [] (size_t, size_t) {}
+        );
+        return;
     }
 
-    return ret;
+    std::vector<std::vector<TINT>> productTree;
+    BuildProductTree(m_keys, productTree);
+    ParallelFor(
+        m_numThreads,
+        values.size(),
+        [&] (size_t valueIndex)
+        {
+            std::vector<TINT> remainders;
+            RemainderTree(values[valueIndex], productTree, remainders, false);
+            std::vector<uint64_t> &words = packed[valueIndex];
+            for (size_t keyIndex = 0; keyIndex < c_numKeys; ++keyIndex)
+            {
+                if (boost::multiprecision::bit_test(remainders[keyIndex], 0))
+                    words[keyIndex / 64] |= uint64_t(1) << (keyIndex % 64);
+            }
+        },
+        [] (size_t, size_t) {}
+    );
+}
+
+//=================================================================================
+void CKeySet::CalculateRNSKeys ()
+{
+    // RNS residues are stored as uint64_t.  Keys need to be less than 2^63 so that
+    // adding two residues can't overflow.
+    static const TINT c_maxRNSKey = TINT(1) << 63;
+    static const TINT c_max32BitKey = TINT(1) << 32;
+
+    m_rnsKeys.clear();
+    m_rnsKeysFit32Bits = false;
+    if (m_keys.empty() || m_keys.back() >= c_maxRNSKey)
+        return;
+
+    m_rnsKeys.resize(m_keys.size());
+    for (size_t i = 0, c = m_keys.size(); i < c; ++i)
+        m_rnsKeys[i] = m_keys[i].convert_to<uint64_t>();
+
+    // if the keys fit in 32 bits, multiplying residues fits in 64 bits
+    m_rnsKeysFit32Bits = m_keys.back() < c_max32BitKey;
 }
\ No newline at end of file
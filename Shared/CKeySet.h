@@ -9,32 +9,174 @@
 #pragma once
 
 #include "TINT.h"
+#include "CBarrettReducer.h"
+#include <algorithm>
 #include <functional>
+#include <atomic>
+#include <mutex>
+#include <string>
+
+//=================================================================================
+// When CKeySet::ReduceValue() actually reduces values mod the keys LCM.  Reducing keeps
+// values small, which speeds up the gates that follow, but costs time itself, so which
+// policy is fastest depends on the circuit.
+//=================================================================================
+enum class EReducePolicy
+{
+    Never,          // never reduce
+    Always,         // reduce after every gate
+    Threshold,      // reduce values with at least min(parameter, 2) times as many bits as the LCM
+    EveryNGates,    // reduce on every parameter'th gate
+};
+
+class CCircuit;
 
 class CKeySet
 {
 public:
-    CKeySet() : m_reduce(false) {}
+    CKeySet() : m_reduce(false), m_reducePolicy(EReducePolicy::Always), m_reduceParameter(1), m_reduceGateCount(0), m_rnsKeysFit32Bits(false), m_numThreads(0), m_memoryLimit(0), m_cacheDirectory("."), m_recorder(nullptr) {}
 
+    // Read() takes either format, and detects the binary format from its header
     bool Read (const char *fileName);
     bool Write (const char *fileName) const;
+    bool ReadBinary (const char *fileName);
+    bool WriteBinary (const char *fileName) const;
+
+    // CalculateCached() uses the key set cache in this directory.  See CKeySetCache.
+    void SetCacheDirectory (const std::string &directory) { m_cacheDirectory = directory; }
 
-    void CalculateCached (int numBits, const TINT& minKey, const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t percent) {} );
-    void Calculate (int numBits, const TINT& minKey, const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t percent) {} );
+    void CalculateCached (int numBits, const TINT& minKey, const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t) {} );
+    void Calculate (int numBits, const TINT& minKey, const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t) {} );
+
+    // How many threads Calculate() spreads its work across.  0 means one per hardware thread.
+    void SetNumThreads (size_t numThreads) { m_numThreads = numThreads; }
+
+    // Roughly how many bytes Calculate() and Extend() may use for chinese remainder theorem
+    // basis values and their sums.  0 means no limit.  If the basis doesn't fit, it's
+    // calculated a chunk at a time and not kept.  Only the basis is limited: the product
+    // tree of the keys (about log2 of the key count times the size of the LCM) isn't, and
+    // GetCRTBasis() keeps the whole basis when it has to make it again.
+    void SetMemoryLimit (size_t bytes) { m_memoryLimit = bytes; }
+
+    // Adds keys and bits to a key set made by Calculate() or read from disk, reusing the
+    // existing keys, LCM and bits.  The result is the same as calculating numBits from
+    // scratch.  Returns false if numBits is smaller than the current number of bits, or
+    // if the existing keys aren't the ones Calculate() would have made.
+    bool Extend (int numBits, const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t) {} );
 
     const std::vector<TINT> &GetSuperPositionedBits () const { return m_superPositionedBits; }
     const std::vector<TINT> &GetKeys () const { return m_keys; }
 
-    void ReduceValue (TINT& v) const { if (m_reduce) { v = v % m_keysLCM; } }
+    // reduces v mod the keys LCM, using a precomputed reciprocal instead of a division.
+    // Whether it does anything depends on the reduce policy.
+    void ReduceValue (TINT& v) const
+    {
+        if (!m_reduce)
+            return;
+
+        switch (m_reducePolicy)
+        {
+            case EReducePolicy::Never:
+                return;
+            case EReducePolicy::Always:
+                break;
+            case EReducePolicy::Threshold:
+            {
+                // Barrett reduction only works below 2^(2k) for a k bit LCM, so the threshold
+                // stops at 2k bits.  Sums crossing it are still in range, but products of
+                // values under it can be up to twice as long and take the division.
+                // msb() only looks at the top limb.
+                const size_t thresholdBits = std::min<size_t>(m_reduceParameter, 2) * m_reducer.GetModulusBits();
+                if (v.sign() <= 0 || boost::multiprecision::msb(v) + 1 < thresholdBits)
+                    return;
+                break;
+            }
+            case EReducePolicy::EveryNGates:
+                if (++m_reduceGateCount % m_reduceParameter != 0)
+                    return;
+                break;
+        }
+        m_reducer.Reduce(v);
+    }
+
+    // Sets when ReduceValue() reduces, and the threshold multiplier (1 or 2, larger values
+    // act like 2) or gate count for the policies that use one.  The default is
+    // EReducePolicy::Always.
+    void SetReducePolicy (EReducePolicy policy, size_t parameter = 1)
+    {
+        m_reducePolicy = policy;
+        m_reduceParameter = parameter > 0 ? parameter : 1;
+        m_reduceGateCount = 0;
+    }
+    EReducePolicy GetReducePolicy () const { return m_reducePolicy; }
+    size_t GetReduceParameter () const { return m_reduceParameter; }
+
+    // The LCM of the keys.  The LCM and its Barrett reciprocal (see CBarrettReducer) are
+    // also kept as 64 bit limbs, least significant first, for bit storage types that
+    // don't use TINT, like CFixedWidthBit.
+    const TINT& GetKeysLCM () const { return m_keysLCM; }
+    size_t GetKeysLCMBits () const { return m_reducer.GetModulusBits(); }
+    const std::vector<uint64_t> &GetKeysLCMLimbs () const { return m_keysLCMLimbs; }
+    const std::vector<uint64_t> &GetKeysLCMReciprocalLimbs () const { return m_keysLCMReciprocalLimbs; }
+
+    // residue number system support, used by CRNSBit.  The RNS keys are empty if
+    // any key is too large to be stored in a machine word.
+    const std::vector<uint64_t> &GetRNSKeys () const { return m_rnsKeys; }
+    bool RNSKeysFit32Bits () const { return m_rnsKeysFit32Bits; }
+    size_t GetKeyIndex (const TINT& key) const;
+    TINT ReconstructFromResidues (const std::vector<uint64_t> &residues) const;
+
+    // Decodes each value for every key: bit k of packed[i] is (values[i] % key k) % 2,
+    // 64 keys to a word.  Much faster than decoding for one key at a time.
+    void DecodeAllKeys (const std::vector<TINT> &values, std::vector<std::vector<uint64_t>> &packed) const;
+
+    // The chinese remainder theorem basis: one value per key which is 1 mod that key and
+    // 0 mod all other keys.  Calculated on demand if the key set was read from disk.  Safe
+    // to call from multiple threads, and from inside a CTINTArenaScope.
+    const std::vector<TINT> &GetCRTBasis () const;
+
+    // Makes a new superpositional value from the basis, which is 1 mod every key that
+    // keyHasBit returns true for, and 0 mod the rest.  Useful for making bit layouts other
+    // than the ones in GetSuperPositionedBits() without doing any modular inverses.
+    TINT CalculateValueFromMask (const std::function<bool (size_t keyIndex)> &keyHasBit) const;
+
+    // While a recorder is set, the TINT HE operations add gates to it instead of doing
+    // math, and TINT bits hold node indices.  See CCircuit.  nullptr stops recording.
+    void SetRecorder (CCircuit *recorder) { m_recorder = recorder; }
+    CCircuit* GetRecorder () const { return m_recorder; }
 
 private:
-    void MakeKey (size_t keyIndex);
-    bool KeyIsCoprime (size_t keyIndex, TINT& value) const;
-    TINT CalculateBit (size_t bitIndex, const std::vector<TINT> &coefficients) const;
+    void OnKeysRead ();
+    void OnKeysLCMChanged ();
+    bool MakeKeys (size_t firstNewKey, const std::function<void (size_t done, size_t count)> &progress);
+    void CalculateCRTBasis (size_t firstKey, const TINT &lcm, const std::vector<std::vector<TINT>> &productTree, const std::vector<TINT> &remainders, size_t begin, size_t end, std::vector<TINT> &basis, const std::function<void (size_t done, size_t count)> &progress) const;
+    void CalculateBits (size_t firstKey, const TINT &lcm, const std::vector<std::vector<TINT>> &productTree, const std::vector<TINT> &remainders, std::vector<TINT> &bits, std::vector<TINT> &basis, const std::function<void (size_t done, size_t count)> &progress, TINT *basisSum = nullptr);
+    void CalculateRNSKeys ();
 
 private:
     std::vector<TINT>   m_superPositionedBits;
     std::vector<TINT>   m_keys;
     TINT                m_keysLCM;
+    std::vector<uint64_t>   m_keysLCMLimbs;
+    std::vector<uint64_t>   m_keysLCMReciprocalLimbs;
     bool                m_reduce;
+    CBarrettReducer     m_reducer;
+
+    EReducePolicy               m_reducePolicy;
+    size_t                      m_reduceParameter;
+    mutable std::atomic<size_t> m_reduceGateCount;
+
+    // filled in by GetCRTBasis() if it's needed and wasn't kept, under the mutex
+    mutable std::vector<TINT>   m_crtBasis;
+    mutable std::mutex          m_crtBasisMutex;
+
+    std::vector<uint64_t>   m_rnsKeys;
+    bool                    m_rnsKeysFit32Bits;
+
+    size_t                  m_numThreads;
+    size_t                  m_memoryLimit;
+
+    std::string             m_cacheDirectory;
+
+    CCircuit*               m_recorder;
 };
\ No newline at end of file
@@ -0,0 +1,181 @@
+//=================================================================================
+//
+//  CKeySetCache
+//
+//  A directory of key set files, with an index file describing them.
+//
+//=================================================================================
+
+#include "CKeySetCache.h"
+#include "CKeySet.h"
+#include "CKeySetFile.h"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <chrono>
+#include <random>
+#include <thread>
+
+static const char *c_indexFileName = "keys_index.txt";
+
+//=================================================================================
+static uint64_t GetFileSize (const std::string &path)
+{
+    std::ifstream file(path.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    if (!file.is_open())
+        return 0;
+    return uint64_t(file.tellg());
+}
+
+//=================================================================================
+// Whether a cached key set's keys are big enough for minKey, without being so much bigger
+// that every gate pays for it.  Keys at most twice as big as needed add at most a bit per
+// key to the LCM.  Past that, it's better to calculate keys for minKey.
+static bool IsUsableMinKey (const TINT &cachedMinKey, const TINT &minKey)
+{
+    return cachedMinKey >= minKey && cachedMinKey <= minKey * 2;
+}
+
+//=================================================================================
+std::string CKeySetCache::GetPath (const std::string &fileName) const
+{
+    if (m_directory.empty() || m_directory == ".")
+        return fileName;
+    const char last = m_directory.back();
+    if (last == '/' || last == '\\')
+        return m_directory + fileName;
+    return m_directory + "/" + fileName;
+}
+
+//=================================================================================
+void CKeySetCache::ReadIndex (std::vector<SEntry> &entries) const
+{
+    entries.clear();
+    std::ifstream file(GetPath(c_indexFileName).c_str());
+    std::string line;
+    while (std::getline(file, line))
+    {
+        // skip anything that doesn't parse, such as a line another process is still writing
+        std::istringstream lineStream(line);
+        SEntry entry;
+        lineStream >> entry.m_numBits >> entry.m_minKey >> entry.m_format >> entry.m_size >> entry.m_fileName;
+        if (lineStream.fail() || (entry.m_format != "txt" && entry.m_format != "bin"))
+            continue;
+        entries.push_back(entry);
+    }
+}
+
+//=================================================================================
+bool CKeySetCache::Find (int numBits, const TINT& minKey, std::string &fileName) const
+{
+    std::vector<SEntry> entries;
+    ReadIndex(entries);
+
+    // The keys are made from the entry's minimum key upwards, so they are all big enough
+    // if that is.  Of those, the lowest minimum key has the smallest keys.  Prefer the
+    // binary format if there's a tie, since it's faster to read.
+    const SEntry *best = nullptr;
+    for (const SEntry &entry : entries)
+    {
+        if (entry.m_numBits != numBits || !IsUsableMinKey(entry.m_minKey, minKey))
+            continue;
+
+        if (best == nullptr || entry.m_minKey < best->m_minKey ||
+            (entry.m_minKey == best->m_minKey && entry.m_format == "bin" && best->m_format != "bin"))
+            best = &entry;
+    }
+
+    if (best == nullptr)
+        return false;
+    fileName = GetPath(best->m_fileName);
+    return true;
+}
+
+//=================================================================================
+bool CKeySetCache::FindToExtend (int numBits, const TINT& minKey, std::string &fileName, TINT &foundMinKey) const
+{
+    std::vector<SEntry> entries;
+    ReadIndex(entries);
+
+    // the most bits means the least work to extend.  Break ties the same way as Find().
+    const SEntry *best = nullptr;
+    for (const SEntry &entry : entries)
+    {
+        if (entry.m_numBits >= numBits || !IsUsableMinKey(entry.m_minKey, minKey))
+            continue;
+
+        if (best == nullptr || entry.m_numBits > best->m_numBits ||
+            (entry.m_numBits == best->m_numBits && entry.m_minKey < best->m_minKey) ||
+            (entry.m_numBits == best->m_numBits && entry.m_minKey == best->m_minKey && entry.m_format == "bin" && best->m_format != "bin"))
+            best = &entry;
+    }
+
+    if (best == nullptr)
+        return false;
+    fileName = GetPath(best->m_fileName);
+    foundMinKey = best->m_minKey;
+    return true;
+}
+
+//=================================================================================
+bool CKeySetCache::AddToIndex (int numBits, const TINT& minKey, const std::string &fileName) const
+{
+    const std::string path = GetPath(fileName);
+    const uint64_t size = GetFileSize(path);
+    if (size == 0)
+        return false;
+
+    // don't add the same file twice
+    std::vector<SEntry> entries;
+    ReadIndex(entries);
+    for (const SEntry &entry : entries)
+    {
+        if (entry.m_fileName == fileName)
+            return true;
+    }
+
+    // Build the whole line first, so that it goes to the file in a single write
+    const char *format = CKeySetFile::IsKeySetFile(path.c_str()) ? "bin" : "txt";
+    std::stringstream line;
+    line << numBits << " " << minKey << " " << format << " " << size << " " << fileName << "\n";
+    const std::string lineString = line.str();
+
+    std::ofstream file(GetPath(c_indexFileName).c_str(), std::ios::out | std::ios::app | std::ios::binary);
+    if (!file.is_open())
+        return false;
+    file.write(lineString.c_str(), lineString.size());
+    file.close();
+    return !file.fail();
+}
+
+//=================================================================================
+bool CKeySetCache::Store (const CKeySet &keySet, int numBits, const TINT& minKey) const
+{
+    std::stringstream fileName;
+    fileName << "keys_" << numBits << "_" << minKey << ".bin";
+
+    // write to a file name no other process or thread will use, then rename it into place
+    std::random_device randomDevice;
+    std::stringstream tempFileName;
+    tempFileName << fileName.str() << "." << randomDevice() << "."
+                 << std::hash<std::thread::id>()(std::this_thread::get_id()) << "."
+                 << std::chrono::high_resolution_clock::now().time_since_epoch().count() << ".tmp";
+    const std::string tempPath = GetPath(tempFileName.str());
+    const std::string path = GetPath(fileName.str());
+    if (!keySet.WriteBinary(tempPath.c_str()))
+    {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    // If the rename fails, another process may have stored the same key set already, in
+    // which case we use theirs.
+    if (std::rename(tempPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tempPath.c_str());
+        if (!CKeySetFile::IsKeySetFile(path.c_str()))
+            return false;
+    }
+
+    return AddToIndex(numBits, minKey, fileName.str());
+}
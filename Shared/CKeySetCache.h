@@ -0,0 +1,72 @@
+//=================================================================================
+//
+//  CKeySetCache
+//
+//  A directory of key set files, with an index file describing them.  Each line
+//  of the index is:
+//
+//    <numBits> <minKey> <format> <size> <fileName>
+//
+//  where format is txt or bin.  A lookup finds the smallest cached key set whose
+//  keys are all at least as large as the requested minimum key, so a key set made
+//  for a larger bound is reused instead of calculating a new one.  Key sets whose
+//  minimum key is more than twice the requested one aren't used, since their larger
+//  keys would make every gate slower.
+//
+//  Key set files are written to a temporary file and renamed into place before
+//  they are added to the index, and index entries are appended one line at a time,
+//  so several processes can fill the same cache at once.  Index lines that can't
+//  be parsed are ignored.
+//
+//  The index and the binary key set files are made as the cache is used, and aren't
+//  checked in.  Text key set files from before the index are added to it the first
+//  time CKeySet::CalculateCached() asks for them by name.
+//
+//=================================================================================
+
+#pragma once
+
+#include "TINT.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+class CKeySet;
+
+class CKeySetCache
+{
+public:
+    CKeySetCache (const std::string &directory) : m_directory(directory) {}
+
+    // finds the cached key set with the lowest minimum key that is >= minKey, and at most
+    // twice minKey
+    bool Find (int numBits, const TINT& minKey, std::string &fileName) const;
+
+    // Finds the cached key set with the most bits below numBits, whose minimum key is
+    // between minKey and twice minKey, to extend with CKeySet::Extend().  Gives back the minimum key it was
+    // stored with.
+    bool FindToExtend (int numBits, const TINT& minKey, std::string &fileName, TINT &foundMinKey) const;
+
+    // writes the key set into the cache directory and adds it to the index
+    bool Store (const CKeySet &keySet, int numBits, const TINT& minKey) const;
+
+    // adds a key set file that is already in the cache directory to the index
+    bool AddToIndex (int numBits, const TINT& minKey, const std::string &fileName) const;
+
+    std::string GetPath (const std::string &fileName) const;
+
+private:
+    struct SEntry
+    {
+        int         m_numBits;
+        TINT        m_minKey;
+        std::string m_format;
+        uint64_t    m_size;
+        std::string m_fileName;
+    };
+
+    void ReadIndex (std::vector<SEntry> &entries) const;
+
+private:
+    std::string m_directory;
+};
@@ -0,0 +1,222 @@
+//=================================================================================
+//
+//  CKeySetFile
+//
+//  A versioned binary key set file, which is memory mapped for reading
+//
+//=================================================================================
+
+#include "CKeySetFile.h"
+#include <fstream>
+#include <cstring>
+
+static const char c_magic[8] = { 'S', 'C', 'K', 'E', 'Y', 'S', 'E', 'T' };
+
+//=================================================================================
+static uint64_t AlignTo8 (uint64_t value)
+{
+    return (value + 7) & ~uint64_t(7);
+}
+
+//=================================================================================
+// whether count elements of elementSize bytes starting at offset are inside of the file,
+// checked in a way that can't overflow
+static bool IsInFile (uint64_t offset, uint64_t count, uint64_t elementSize, uint64_t fileSize)
+{
+    return offset <= fileSize && count <= (fileSize - offset) / elementSize;
+}
+
+//=================================================================================
+static uint64_t FNV1a (uint64_t hash, const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+static const uint64_t c_fnv1aStart = 14695981039346656037ull;
+
+//=================================================================================
+bool CKeySetFile::Open (const char *fileName, bool verifyChecksum)
+{
+    Close();
+
+    try
+    {
+        m_file = boost::interprocess::file_mapping(fileName, boost::interprocess::read_only);
+        m_region = boost::interprocess::mapped_region(m_file, boost::interprocess::read_only);
+    }
+    catch (const boost::interprocess::interprocess_exception &)
+    {
+        Close();
+        return false;
+    }
+
+    // validate the header
+    const uint64_t fileSize = m_region.get_size();
+    const SKeySetFileHeader *header = (const SKeySetFileHeader*)m_region.get_address();
+    if (fileSize < sizeof(SKeySetFileHeader) ||
+        memcmp(header->m_magic, c_magic, sizeof(c_magic)) != 0 ||
+        header->m_version != c_version ||
+        header->m_headerSize != sizeof(SKeySetFileHeader) ||
+        header->m_fileSize != fileSize ||
+        header->m_numBits >= 64 ||
+        header->m_numKeys != uint64_t(1) << header->m_numBits ||
+        !IsInFile(header->m_valuesOffset, header->m_numBits + 1, sizeof(SKeySetFileValue), fileSize) ||
+        !IsInFile(header->m_keyOffsetsOffset, header->m_numKeys, sizeof(uint32_t), fileSize) ||
+        header->m_valuesOffset % 8 != 0 ||
+        header->m_keyOffsetsOffset % sizeof(uint32_t) != 0)
+    {
+        Close();
+        return false;
+    }
+
+    // validate the values
+    const SKeySetFileValue *values = (const SKeySetFileValue*)((const uint8_t*)header + header->m_valuesOffset);
+    for (uint64_t i = 0; i <= header->m_numBits; ++i)
+    {
+        if (values[i].m_limbsOffset % 8 != 0 ||
+            !IsInFile(values[i].m_limbsOffset, values[i].m_numLimbs, sizeof(uint64_t), fileSize))
+        {
+            Close();
+            return false;
+        }
+    }
+
+    if (verifyChecksum)
+    {
+        const uint8_t *data = (const uint8_t*)header;
+        uint64_t checksum = FNV1a(c_fnv1aStart, data + sizeof(SKeySetFileHeader), size_t(fileSize - sizeof(SKeySetFileHeader)));
+        if (checksum != header->m_checksum)
+        {
+            Close();
+            return false;
+        }
+    }
+
+    m_header = header;
+    return true;
+}
+
+//=================================================================================
+void CKeySetFile::Close ()
+{
+    m_header = nullptr;
+    m_region = boost::interprocess::mapped_region();
+    m_file = boost::interprocess::file_mapping();
+}
+
+//=================================================================================
+bool CKeySetFile::IsKeySetFile (const char *fileName)
+{
+    std::ifstream file(fileName, std::ios::in | std::ios::binary);
+    char magic[sizeof(c_magic)];
+    if (!file.read(magic, sizeof(magic)))
+        return false;
+    return memcmp(magic, c_magic, sizeof(c_magic)) == 0;
+}
+
+//=================================================================================
+bool CKeySetFile::Write (const char *fileName, const std::vector<TINT> &superPositionedBits, const std::vector<TINT> &keys)
+{
+    if (keys.empty() || keys.size() != size_t(1) << superPositionedBits.size())
+        return false;
+
+    // the keys are stored as 32 bit offsets from the first key
+    std::vector<uint32_t> keyOffsets(keys.size());
+    for (size_t i = 0, c = keys.size(); i < c; ++i)
+    {
+        TINT offset = keys[i] - keys[0];
+        if (offset < 0 || offset > TINT(UINT32_MAX))
+            return false;
+        keyOffsets[i] = offset.convert_to<uint32_t>();
+    }
+
+    // the first key, then the bits
+    std::vector<std::vector<uint64_t>> valueLimbs(superPositionedBits.size() + 1);
+    TINTToLimbs(keys[0], valueLimbs[0]);
+    for (size_t i = 0, c = superPositionedBits.size(); i < c; ++i)
+    {
+        if (superPositionedBits[i] < 0)
+            return false;
+        TINTToLimbs(superPositionedBits[i], valueLimbs[i + 1]);
+    }
+
+    // lay out the file
+    SKeySetFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.m_magic, c_magic, sizeof(c_magic));
+    header.m_version = c_version;
+    header.m_headerSize = sizeof(SKeySetFileHeader);
+    header.m_numBits = superPositionedBits.size();
+    header.m_numKeys = keys.size();
+    header.m_valuesOffset = sizeof(SKeySetFileHeader);
+    header.m_keyOffsetsOffset = header.m_valuesOffset + valueLimbs.size() * sizeof(SKeySetFileValue);
+
+    std::vector<SKeySetFileValue> values(valueLimbs.size());
+    uint64_t offset = AlignTo8(header.m_keyOffsetsOffset + keyOffsets.size() * sizeof(uint32_t));
+    for (size_t i = 0, c = values.size(); i < c; ++i)
+    {
+        values[i].m_limbsOffset = offset;
+        values[i].m_numLimbs = valueLimbs[i].size();
+        offset += valueLimbs[i].size() * sizeof(uint64_t);
+    }
+    header.m_fileSize = offset;
+
+    // write everything after the header, calculating the checksum as we go
+    std::ofstream file(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+        return false;
+
+    uint64_t checksum = c_fnv1aStart;
+    auto write = [&file, &checksum] (const void *data, size_t size)
+    {
+        file.write((const char*)data, size);
+        checksum = FNV1a(checksum, (const uint8_t*)data, size);
+    };
+
+    file.write((const char*)&header, sizeof(header));
+    write(values.data(), values.size() * sizeof(SKeySetFileValue));
+    write(keyOffsets.data(), keyOffsets.size() * sizeof(uint32_t));
+    const uint64_t padding = 0;
+    write(&padding, size_t(values[0].m_limbsOffset - (header.m_keyOffsetsOffset + keyOffsets.size() * sizeof(uint32_t))));
+    for (const std::vector<uint64_t> &limbs : valueLimbs)
+        write(limbs.data(), limbs.size() * sizeof(uint64_t));
+
+    // now that we know the checksum, rewrite the header
+    header.m_checksum = checksum;
+    file.seekp(0);
+    file.write((const char*)&header, sizeof(header));
+    file.close();
+    return !file.fail();
+}
+
+//=================================================================================
+const uint64_t *CKeySetFile::GetValueLimbs (size_t valueIndex, size_t &numLimbs) const
+{
+    const SKeySetFileValue *values = (const SKeySetFileValue*)(GetData() + m_header->m_valuesOffset);
+    numLimbs = size_t(values[valueIndex].m_numLimbs);
+    return (const uint64_t*)(GetData() + values[valueIndex].m_limbsOffset);
+}
+
+//=================================================================================
+TINT CKeySetFile::GetValue (size_t valueIndex) const
+{
+    size_t numLimbs;
+    const uint64_t *limbs = GetValueLimbs(valueIndex, numLimbs);
+    return TINTFromLimbs(limbs, numLimbs);
+}
+
+//=================================================================================
+TINT CKeySetFile::GetFirstKey () const
+{
+    return GetValue(0);
+}
+
+//=================================================================================
+TINT CKeySetFile::GetBit (size_t bitIndex) const
+{
+    return GetValue(bitIndex + 1);
+}
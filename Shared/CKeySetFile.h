@@ -0,0 +1,85 @@
+//=================================================================================
+//
+//  CKeySetFile
+//
+//  A versioned binary key set file, which is memory mapped for reading.  Values are
+//  stored as raw little endian 64 bit limbs instead of decimal text, so nothing has
+//  to be parsed, and the keys are stored as 32 bit offsets from the first key.
+//
+//  Layout, with every section 8 byte aligned:
+//    SKeySetFileHeader
+//    SKeySetFileValue[numBits + 1]  - the first key, then each superpositioned bit
+//    uint32_t[numKeys]               - each key's offset from the first key
+//    uint64_t limbs[]                - the limbs of all the values
+//
+//  The checksum is FNV-1a over everything after the header.
+//
+//=================================================================================
+
+#pragma once
+
+#include "TINT.h"
+#include <stdint.h>
+#include <vector>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+struct SKeySetFileHeader
+{
+    char        m_magic[8];
+    uint32_t    m_version;
+    uint32_t    m_headerSize;
+    uint64_t    m_numBits;
+    uint64_t    m_numKeys;
+    uint64_t    m_valuesOffset;
+    uint64_t    m_keyOffsetsOffset;
+    uint64_t    m_fileSize;
+    uint64_t    m_checksum;
+};
+
+struct SKeySetFileValue
+{
+    uint64_t    m_limbsOffset;
+    uint64_t    m_numLimbs;
+};
+
+class CKeySetFile
+{
+public:
+    static const uint32_t c_version = 1;
+
+    CKeySetFile () : m_header(nullptr) {}
+
+    // Maps the file and validates it.  The checksum is a pass over the whole file, so
+    // can be skipped if the file is known to be good.
+    bool Open (const char *fileName, bool verifyChecksum = true);
+    void Close ();
+    bool IsOpen () const { return m_header != nullptr; }
+
+    static bool IsKeySetFile (const char *fileName);
+    static bool Write (const char *fileName, const std::vector<TINT> &superPositionedBits, const std::vector<TINT> &keys);
+
+    size_t GetNumBits () const { return size_t(m_header->m_numBits); }
+    size_t GetNumKeys () const { return size_t(m_header->m_numKeys); }
+
+    // zero copy access to the mapped data
+    const uint64_t *GetFirstKeyLimbs (size_t &numLimbs) const { return GetValueLimbs(0, numLimbs); }
+    const uint64_t *GetBitLimbs (size_t bitIndex, size_t &numLimbs) const { return GetValueLimbs(bitIndex + 1, numLimbs); }
+    uint32_t GetKeyOffset (size_t keyIndex) const { return GetKeyOffsets()[keyIndex]; }
+
+    // copies out of the mapped data
+    TINT GetFirstKey () const;
+    TINT GetBit (size_t bitIndex) const;
+    TINT GetKey (size_t keyIndex) const { return GetFirstKey() + GetKeyOffset(keyIndex); }
+
+private:
+    const uint8_t *GetData () const { return (const uint8_t*)m_header; }
+    const uint32_t *GetKeyOffsets () const { return (const uint32_t*)(GetData() + m_header->m_keyOffsetsOffset); }
+    const uint64_t *GetValueLimbs (size_t valueIndex, size_t &numLimbs) const;
+    TINT GetValue (size_t valueIndex) const;
+
+private:
+    boost::interprocess::file_mapping   m_file;
+    boost::interprocess::mapped_region  m_region;
+    const SKeySetFileHeader            *m_header;
+};
@@ -0,0 +1,57 @@
+//=================================================================================
+//
+//  CRNSBit
+//
+//  A superpositional bit stored in residue number system (RNS) form
+//
+//=================================================================================
+
+#include "CRNSBit.h"
+
+//=================================================================================
+bool CRNSBit::SetFromTINT (const TINT& value, const CKeySet& keySet)
+{
+    if (!CanStore(keySet))
+        return false;
+
+    const std::vector<TINT> &keys = keySet.GetKeys();
+    m_residues.resize(keys.size());
+    for (size_t i = 0, c = keys.size(); i < c; ++i)
+    {
+        TINT residue = value % keys[i];
+        m_residues[i] = residue.convert_to<uint64_t>();
+    }
+    m_constant = 0;
+    return true;
+}
+
+//=================================================================================
+TINT CRNSBit::ToTINT (const CKeySet& keySet) const
+{
+    if (IsConstant())
+        return TINT(m_constant);
+    return keySet.ReconstructFromResidues(m_residues);
+}
+
+//=================================================================================
+uint64_t CRNSBit::GetResidue (size_t keyIndex, const CKeySet& keySet) const
+{
+    if (IsConstant())
+        return m_constant % keySet.GetRNSKeys()[keyIndex];
+    return m_residues[keyIndex];
+}
+
+//=================================================================================
+void CRNSBit::Expand (const CKeySet& keySet)
+{
+    if (!IsConstant())
+        return;
+
+    // the key set has keys, but they are too large for RNS storage
+    const std::vector<uint64_t> &keys = keySet.GetRNSKeys();
+    Assert_(!keys.empty() || keySet.GetKeys().empty());
+
+    m_residues.resize(keys.size());
+    for (size_t i = 0, c = keys.size(); i < c; ++i)
+        m_residues[i] = m_constant % keys[i];
+}
@@ -0,0 +1,199 @@
+//=================================================================================
+//
+//  CRNSBit
+//
+//  A superpositional bit stored in residue number system (RNS) form: one machine
+//  word residue per key in the key set, instead of one giant TINT.  XOR and AND
+//  become element wise add and multiply mod each key over a flat buffer, and the
+//  full integer is only reconstructed (via the chinese remainder theorem) on demand.
+//
+//  Use it as the bit storage type of a CSuperInt, like CSuperInt<3, CRNSBit>.
+//  Requires every key in the key set to be less than 2^63, see CRNSBit::CanStore().
+//
+//=================================================================================
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "CKeySet.h"
+#include "TINT.h"
+#include "Macros.h"
+
+class CRNSBit
+{
+public:
+    // initialize to a non superpositional value.  Plaintext values don't need to
+    // know the key set, so they are expanded into residues the first time they are
+    // combined with a superpositional bit.
+    CRNSBit (int value = 0) : m_constant(uint64_t(value)) {}
+
+    // set to a superpositional TINT value.  Returns false and leaves the bit alone if
+    // the key set's keys are too large for RNS storage (see CanStore()).
+    bool SetFromTINT (const TINT& value, const CKeySet& keySet);
+
+    // whether every key in the key set is less than 2^63
+    static bool CanStore (const CKeySet& keySet) { return keySet.GetRNSKeys().size() == keySet.GetKeys().size(); }
+
+    // reconstruct the full TINT value
+    TINT ToTINT (const CKeySet& keySet) const;
+
+    // get the value of this bit mod a specific key
+    uint64_t GetResidue (size_t keyIndex, const CKeySet& keySet) const;
+
+    // make sure this bit is stored as residues instead of a plaintext value
+    void Expand (const CKeySet& keySet);
+
+    bool IsConstant () const { return m_residues.empty(); }
+    uint64_t GetConstant () const { return m_constant; }
+    void SetConstant (uint64_t value) { m_residues.clear(); m_constant = value; }
+
+    const std::vector<uint64_t>& GetResidues () const { return m_residues; }
+    std::vector<uint64_t>& GetResidues () { return m_residues; }
+
+private:
+    std::vector<uint64_t>   m_residues; // one residue per key, empty if plaintext
+    uint64_t                m_constant; // plaintext value, used if m_residues is empty
+};
+
+//=================================================================================
+// Residue math
+//=================================================================================
+inline uint64_t RNSAddMod (uint64_t a, uint64_t b, uint64_t key)
+{
+    // a and b are both less than key, and key < 2^63, so this can't overflow
+    uint64_t result = a + b;
+    return result >= key ? result - key : result;
+}
+
+//=================================================================================
+inline uint64_t RNSMulMod (uint64_t a, uint64_t b, uint64_t key, bool keysFit32Bits)
+{
+    if (keysFit32Bits)
+        return (a * b) % key;
+
+    #if defined(__SIZEOF_INT128__)
+        return uint64_t(((unsigned __int128)a * b) % key);
+    #else
+        boost::multiprecision::uint128_t result = a;
+        result *= b;
+        result %= key;
+        return result.convert_to<uint64_t>();
+    #endif
+}
+
+//=================================================================================
+// HE operations
+//=================================================================================
+inline void XOREQ (CRNSBit &A, const CRNSBit &B, const CKeySet &keySet)
+{
+    const std::vector<uint64_t> &keys = keySet.GetRNSKeys();
+    if (A.IsConstant() && B.IsConstant() && keys.empty())
+    {
+        A.SetConstant(A.GetConstant() + B.GetConstant());
+        return;
+    }
+
+    A.Expand(keySet);
+    std::vector<uint64_t> &a = A.GetResidues();
+    const size_t c_numKeys = keys.size();
+    if (B.IsConstant())
+    {
+        for (size_t i = 0; i < c_numKeys; ++i)
+            a[i] = RNSAddMod(a[i], B.GetConstant() % keys[i], keys[i]);
+    }
+    else
+    {
+        const std::vector<uint64_t> &b = B.GetResidues();
+        for (size_t i = 0; i < c_numKeys; ++i)
+            a[i] = RNSAddMod(a[i], b[i], keys[i]);
+    }
+}
+
+//=================================================================================
+inline CRNSBit XOR (const CRNSBit &A, const CRNSBit &B, const CKeySet &keySet)
+{
+    CRNSBit result(A);
+    XOREQ(result, B, keySet);
+    return result;
+}
+
+//=================================================================================
+inline void ANDEQ (CRNSBit &A, const CRNSBit &B, const CKeySet &keySet)
+{
+    const std::vector<uint64_t> &keys = keySet.GetRNSKeys();
+    if (A.IsConstant() && B.IsConstant() && keys.empty())
+    {
+        A.SetConstant(A.GetConstant() * B.GetConstant());
+        return;
+    }
+
+    A.Expand(keySet);
+    std::vector<uint64_t> &a = A.GetResidues();
+    const size_t c_numKeys = keys.size();
+    const bool c_keysFit32Bits = keySet.RNSKeysFit32Bits();
+    if (B.IsConstant())
+    {
+        for (size_t i = 0; i < c_numKeys; ++i)
+            a[i] = RNSMulMod(a[i], B.GetConstant() % keys[i], keys[i], c_keysFit32Bits);
+    }
+    else
+    {
+        const std::vector<uint64_t> &b = B.GetResidues();
+        for (size_t i = 0; i < c_numKeys; ++i)
+            a[i] = RNSMulMod(a[i], b[i], keys[i], c_keysFit32Bits);
+    }
+}
+
+//=================================================================================
+inline CRNSBit AND (const CRNSBit &A, const CRNSBit &B, const CKeySet &keySet)
+{
+    CRNSBit result(A);
+    ANDEQ(result, B, keySet);
+    return result;
+}
+
+//=================================================================================
+inline CRNSBit NOT (const CRNSBit &A, const CKeySet &keySet)
+{
+    return XOR(A, CRNSBit(1), keySet);
+}
+
+//=================================================================================
+// Bit storage interface used by CSuperInt
+//=================================================================================
+// CSuperInt can't report errors from its constructor, so check CRNSBit::CanStore() on the
+// key set before making a CSuperInt with CRNSBit storage from superpositional bits.
+inline void BitFromTINT (const TINT &value, const CKeySet &keySet, CRNSBit &bit)
+{
+    const bool c_stored = bit.SetFromTINT(value, keySet);
+    Assert_(c_stored);
+}
+
+//=================================================================================
+inline TINT BitToTINT (const CRNSBit &bit, const CKeySet &keySet)
+{
+    return bit.ToTINT(keySet);
+}
+
+//=================================================================================
+inline size_t DecodeBit (const CRNSBit &bit, const TINT &key, const CKeySet &keySet)
+{
+    return size_t(bit.GetResidue(keySet.GetKeyIndex(key), keySet) % 2);
+}
+
+//=================================================================================
+inline void DecodeBitsAllKeys (const CRNSBit *bits, size_t numBits, const CKeySet &keySet, std::vector<std::vector<uint64_t>> &packed)
+{
+    // the residues are already reduced by each key, so there is nothing to divide
+    const size_t c_numKeys = keySet.GetKeys().size();
+    packed.assign(numBits, std::vector<uint64_t>((c_numKeys + 63) / 64, 0));
+    for (size_t bitIndex = 0; bitIndex < numBits; ++bitIndex)
+    {
+        for (size_t keyIndex = 0; keyIndex < c_numKeys; ++keyIndex)
+        {
+            if (bits[bitIndex].GetResidue(keyIndex, keySet) & 1)
+                packed[bitIndex][keyIndex / 64] |= uint64_t(1) << (keyIndex % 64);
+        }
+    }
+}
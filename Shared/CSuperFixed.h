@@ -14,7 +14,7 @@
 #define CSUPERFIXED_EXTENDPRECISION_MULTIPLY()  0
 #define CSUPERFIXED_EXTENDPRECISION_DIVIDE()    0
 
-template <size_t BITS_INTEGER, size_t BITS_FRACTION>
+template <size_t BITS_INTEGER, size_t BITS_FRACTION, typename TBIT = TINT>
 class CSuperFixed
 {
 public:
@@ -42,6 +42,22 @@ public:
         static_assert(BITS_INTEGER + BITS_FRACTION > 0, "size must be greater than 0");
     }
 
+    // copy and move, spelled out for VS2013 like CSuperInt's
+    CSuperFixed (const CSuperFixed &other) : m_int(other.m_int) {}
+    CSuperFixed (CSuperFixed &&other) : m_int(std::move(other.m_int)) {}
+
+    CSuperFixed& operator = (const CSuperFixed &other)
+    {
+        m_int = other.m_int;
+        return *this;
+    }
+
+    CSuperFixed& operator = (CSuperFixed &&other)
+    {
+        m_int = std::move(other.m_int);
+        return *this;
+    }
+
     void SetFloat (float value)
     {
         m_int.SetInt((int)(value * c_floatToInt));
@@ -63,7 +79,7 @@ public:
         return m_int.DecodeBinary(key);
     }
 
-    const CSuperInt<BITS_INTEGER + BITS_FRACTION>& GetInternalInt () const
+    const CSuperInt<BITS_INTEGER + BITS_FRACTION, TBIT>& GetInternalInt () const
     {
         return m_int;
     }
@@ -77,39 +93,63 @@ public:
         m_int.SetToBinaryMax();
     }
 
-    const std::array<TINT, BITS_INTEGER + BITS_FRACTION>& GetBits() const {
+    const std::array<TBIT, BITS_INTEGER + BITS_FRACTION>& GetBits() const {
         return m_int.GetBits();
     }
 
-    std::array<TINT, BITS_INTEGER + BITS_FRACTION>& GetBits() {
+    std::array<TBIT, BITS_INTEGER + BITS_FRACTION>& GetBits() {
         return m_int.GetBits();
     }
 
     //=================================================================================
     // Math operations
     //=================================================================================
-    CSuperFixed<BITS_INTEGER, BITS_FRACTION> operator + (const CSuperFixed<BITS_INTEGER, BITS_FRACTION>& other) const
+    CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> operator + (const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& other) const
     {
-        CSuperFixed<BITS_INTEGER, BITS_FRACTION> result(m_int.GetKeySet());
-        result.m_int = m_int + other.m_int;
+        CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> result(*this);
+        result += other;
         return result;
     }
 
-    CSuperFixed<BITS_INTEGER, BITS_FRACTION> operator - (const CSuperFixed<BITS_INTEGER, BITS_FRACTION>& other) const
+    CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> operator - (const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& other) const
     {
-        CSuperFixed<BITS_INTEGER, BITS_FRACTION> result(m_int.GetKeySet());
-        result.m_int = m_int - other.m_int;
+        CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> result(*this);
+        result -= other;
         return result;
     }
 
-    CSuperFixed<BITS_INTEGER, BITS_FRACTION> operator * (const CSuperFixed<BITS_INTEGER, BITS_FRACTION>& other) const
+    CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& operator += (const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& other)
+    {
+        m_int += other.m_int;
+        return *this;
+    }
+
+    CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& operator -= (const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& other)
+    {
+        m_int -= other.m_int;
+        return *this;
+    }
+
+    CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& operator *= (const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& other)
+    {
+        *this = *this * other;
+        return *this;
+    }
+
+    CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& operator /= (const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& other)
+    {
+        *this = *this / other;
+        return *this;
+    }
+
+    CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> operator * (const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& other) const
     {
         #if CSUPERFIXED_EXTENDPRECISION_MULTIPLY()
             const size_t c_intermediaryBits = (BITS_INTEGER + BITS_FRACTION) * 2 - 1;
 
             // copy values into larger intermediary sized integer
-            CSuperInt<c_intermediaryBits> a(m_int.GetKeySet());
-            CSuperInt<c_intermediaryBits> b(m_int.GetKeySet());
+            CSuperInt<c_intermediaryBits, TBIT> a(m_int.GetKeySet());
+            CSuperInt<c_intermediaryBits, TBIT> b(m_int.GetKeySet());
             for (size_t i = 0; i < (BITS_INTEGER + BITS_FRACTION); ++i)
             {
                 a.GetBit(i) = m_int.GetBit(i);
@@ -117,8 +157,8 @@ public:
             }
 
             // sign extend the larger intermediary numbers
-            const TINT& aNeg = m_int.IsNegative();
-            const TINT& bNeg = other.m_int.IsNegative();
+            const TBIT& aNeg = m_int.IsNegative();
+            const TBIT& bNeg = other.m_int.IsNegative();
             for (size_t i = (BITS_INTEGER + BITS_FRACTION); i < c_intermediaryBits; ++i)
             {
                 a.GetBit(i) = aNeg;
@@ -126,30 +166,30 @@ public:
             }
 
             // do the math in higher bit intermediary format
-            CSuperInt<c_intermediaryBits> c = a * b;
+            CSuperInt<c_intermediaryBits, TBIT> c = a * b;
             c.SignedShiftRight(BITS_FRACTION);
 
             // copy values back into normal sized value and return it
-            CSuperFixed<BITS_INTEGER, BITS_FRACTION> result(m_int.GetKeySet());
+            CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> result(m_int.GetKeySet());
             for (size_t i = 0; i < (BITS_INTEGER + BITS_FRACTION); ++i)
                 result.m_int.GetBit(i) = c.GetBit(i);
             return result;
         #else
-            CSuperFixed<BITS_INTEGER, BITS_FRACTION> result(m_int.GetKeySet());
+            CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> result(m_int.GetKeySet());
             result.m_int = m_int * other.m_int;
             result.m_int.SignedShiftRight(BITS_FRACTION);
             return result;
         #endif
     }
 
-    CSuperFixed<BITS_INTEGER, BITS_FRACTION> operator / (const CSuperFixed<BITS_INTEGER, BITS_FRACTION>& other) const
+    CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> operator / (const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>& other) const
     {
         #if CSUPERFIXED_EXTENDPRECISION_DIVIDE()
             const size_t c_intermediaryBits = (BITS_INTEGER + BITS_FRACTION + BITS_FRACTION);
 
             // copy values into larger intermediary sized integer
-            CSuperInt<c_intermediaryBits> a(m_int.GetKeySet());
-            CSuperInt<c_intermediaryBits> b(m_int.GetKeySet());
+            CSuperInt<c_intermediaryBits, TBIT> a(m_int.GetKeySet());
+            CSuperInt<c_intermediaryBits, TBIT> b(m_int.GetKeySet());
             for (size_t i = 0; i < (BITS_INTEGER + BITS_FRACTION); ++i)
             {
                 a.GetBit(i) = m_int.GetBit(i);
@@ -157,8 +197,8 @@ public:
             }
 
             // sign extend the larger intermediary numbers
-            const TINT& aNeg = m_int.IsNegative();
-            const TINT& bNeg = other.m_int.IsNegative();
+            const TBIT& aNeg = m_int.IsNegative();
+            const TBIT& bNeg = other.m_int.IsNegative();
             for (size_t i = (BITS_INTEGER + BITS_FRACTION); i < c_intermediaryBits; ++i)
             {
                 a.GetBit(i) = aNeg;
@@ -167,18 +207,17 @@ public:
 
             // do the math in higher bit intermediary format
             a.ShiftLeft(BITS_FRACTION);
-            CSuperInt<c_intermediaryBits> c = a / b;
+            CSuperInt<c_intermediaryBits, TBIT> c = a / b;
 
             // copy values back into normal sized value and return it
-            CSuperFixed<BITS_INTEGER, BITS_FRACTION> result(m_int.GetKeySet());
+            CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> result(m_int.GetKeySet());
             for (size_t i = 0; i < (BITS_INTEGER + BITS_FRACTION); ++i)
                 result.m_int.GetBit(i) = c.GetBit(i);
             return result;
         #else
-            CSuperInt<BITS_INTEGER + BITS_FRACTION> temp(m_int);
-            temp.ShiftLeft(BITS_FRACTION);
-            CSuperFixed<BITS_INTEGER, BITS_FRACTION> result(m_int.GetKeySet());
-            result.m_int = temp / other.m_int;
+            CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> result(*this);
+            result.m_int.ShiftLeft(BITS_FRACTION);
+            result.m_int /= other.m_int;
             return result;
         #endif
     }
@@ -189,7 +228,7 @@ public:
         m_int.Negate();
     }
 
-    void NegateConditional (const TINT& condition)
+    void NegateConditional (const TBIT& condition)
     {
         m_int.NegateConditional(condition);
     }
@@ -201,22 +240,24 @@ public:
     }
 
     // returns a superpositional value for whether or not this number is negative
-    const TINT& IsNegative() const { return m_int.IsNegative() }
+    const TBIT& IsNegative() const { return m_int.IsNegative() }
 
 public:
     static const size_t c_numBits = BITS_INTEGER + BITS_FRACTION;
     static const size_t c_numIntegerBits = BITS_INTEGER;
     static const size_t c_numFractionBits = BITS_FRACTION;
 
+    typedef TBIT TBit;
+
 private:
-    CSuperInt<BITS_INTEGER + BITS_FRACTION> m_int;
+    CSuperInt<BITS_INTEGER + BITS_FRACTION, TBIT> m_int;
 
     static const float c_floatToInt;
     static const float c_intToFloat;
 };
 
-template <size_t BITS_INTEGER, size_t BITS_FRACTION>
-const float CSuperFixed<BITS_INTEGER, BITS_FRACTION>::c_floatToInt = std::pow(2.0f, (float)BITS_FRACTION);
+template <size_t BITS_INTEGER, size_t BITS_FRACTION, typename TBIT>
+const float CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>::c_floatToInt = std::pow(2.0f, (float)BITS_FRACTION);
 
-template <size_t BITS_INTEGER, size_t BITS_FRACTION>
-const float CSuperFixed<BITS_INTEGER, BITS_FRACTION>::c_intToFloat = 1.0f / CSuperFixed<BITS_INTEGER, BITS_FRACTION>::c_floatToInt;
+template <size_t BITS_INTEGER, size_t BITS_FRACTION, typename TBIT>
+const float CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>::c_intToFloat = 1.0f / CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT>::c_floatToInt;
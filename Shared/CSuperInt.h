@@ -12,12 +12,162 @@
 #include <vector>
 #include <array>
 #include <memory>
+#include <utility>
 #include "Macros.h"
 #include "CKeySet.h"
 #include "TINT.h"
+#include "CRNSBit.h"
+#include "CTINTArena.h"
+#include "CCircuit.h"
 
 //=================================================================================
-template <size_t NUMBITS>
+// HE operations
+//
+// Plaintext bits, like the ones SetInt(), ShiftLeft() and the constructors make, are
+// the TINT values 0 and 1.  Superpositional bits are much larger, so the gates skip
+// the math when an input is a plaintext bit that makes it trivial: A XOR 0 = A,
+// A AND 0 = 0 and A AND 1 = A.  These hold exactly, not just mod the keys, so they
+// also work while recording a circuit, where 0 and 1 are the constant nodes.
+//=================================================================================
+inline TINT XOR (const TINT &A, const TINT &B, const CKeySet &keySet)
+{
+    if (B == 0)
+        return A;
+    if (A == 0)
+        return B;
+
+    if (CCircuit *circuit = keySet.GetRecorder())
+        return circuit->AddGate(ECircuitNode::XOR, A, B);
+
+    TINT result = A + B;
+    keySet.ReduceValue(result);
+    return result;
+}
+
+//=================================================================================
+inline TINT AND(const TINT &A, const TINT &B, const CKeySet &keySet)
+{
+    if (A == 0 || B == 0)
+        return TINT(0);
+    if (B == 1)
+        return A;
+    if (A == 1)
+        return B;
+
+    if (CCircuit *circuit = keySet.GetRecorder())
+        return circuit->AddGate(ECircuitNode::AND, A, B);
+
+    TINT result = A * B;
+    keySet.ReduceValue(result);
+    return result;
+}
+
+//=================================================================================
+inline TINT NOT(const TINT &A, const CKeySet &keySet)
+{
+    return XOR(A, TINT(1), keySet);
+}
+
+//=================================================================================
+inline void XOREQ (TINT &A, const TINT &B, const CKeySet &keySet)
+{
+    if (B == 0)
+        return;
+    if (A == 0)
+    {
+        A = B;
+        return;
+    }
+
+    if (CCircuit *circuit = keySet.GetRecorder())
+    {
+        A = circuit->AddGate(ECircuitNode::XOR, A, B);
+        return;
+    }
+
+    A += B;
+    keySet.ReduceValue(A);
+}
+
+//=================================================================================
+inline void ANDEQ (TINT &A, const TINT &B, const CKeySet &keySet)
+{
+    if (A == 0 || B == 1)
+        return;
+    if (B == 0 || A == 1)
+    {
+        A = B;
+        return;
+    }
+
+    if (CCircuit *circuit = keySet.GetRecorder())
+    {
+        A = circuit->AddGate(ECircuitNode::AND, A, B);
+        return;
+    }
+
+    A *= B;
+    keySet.ReduceValue(A);
+}
+
+//=================================================================================
+// A = NOT(A), for any bit storage type with XOREQ()
+//=================================================================================
+template <typename TBIT>
+void NOTEQ (TBIT &A, const CKeySet &keySet)
+{
+    XOREQ(A, TBIT(1), keySet);
+}
+
+//=================================================================================
+// Bit storage interface.  CSuperInt can store its bits in any type that has these
+// functions and the HE operations above defined for it (see CRNSBit).
+//=================================================================================
+inline void BitFromTINT (const TINT &value, const CKeySet &, TINT &bit)
+{
+    bit = value;
+}
+
+//=================================================================================
+inline TINT BitToTINT (const TINT &bit, const CKeySet &)
+{
+    return bit;
+}
+
+//=================================================================================
+inline size_t DecodeBit (const TINT &bit, const TINT &key, const CKeySet &)
+{
+    TINT value = (bit % key) % 2;
+    return value.convert_to<size_t>();
+}
+
+//=================================================================================
+inline void DecodeBitsAllKeys (const TINT *bits, size_t numBits, const CKeySet &keySet, std::vector<std::vector<uint64_t>> &packed)
+{
+    keySet.DecodeAllKeys(std::vector<TINT>(bits, bits + numBits), packed);
+}
+
+//=================================================================================
+// Homomorphically adds the encrypted bits A, B and carryBit.  A gets the single bit
+// sum and carryBit gets the carry out.
+// From http://en.wikipedia.org/w/index.php?title=Adder_(electronics)&oldid=381607326#Full_adder
+//=================================================================================
+template <typename TBIT>
+void FullAdderEQ (TBIT &A, const TBIT &B, TBIT &carryBit, const CKeySet &keySet)
+{
+    // sum = (A XOR B) XOR carry
+    // carry = (A AND B) XOR (carry AND (A XOR B))
+    TBIT AxorB = XOR(A, B, keySet);
+    TBIT carryAndAxorB = AND(carryBit, AxorB, keySet);
+    ANDEQ(A, B, keySet);
+    XOREQ(A, carryAndAxorB, keySet);
+    XOREQ(AxorB, carryBit, keySet);
+    carryBit = std::move(A);
+    A = std::move(AxorB);
+}
+
+//=================================================================================
+template <size_t NUMBITS, typename TBIT = TINT>
 class CSuperInt
 {
 public:
@@ -45,7 +195,37 @@ public:
     {
         static_assert(NUMBITS > 0, "NUMBITS must be greater than 0");
         for (size_t i = 0; i < NUMBITS; ++i)
-            m_bits[i] = bitsBegin[i];
+            BitFromTINT(bitsBegin[i], *m_keySet, m_bits[i]);
+    }
+
+    // copy and move.  These are spelled out because VS2013 doesn't generate move
+    // constructors or move assignment.
+    CSuperInt (const CSuperInt &other)
+        : m_bits(other.m_bits)
+        , m_keySet(other.m_keySet)
+    {
+    }
+
+    CSuperInt (CSuperInt &&other)
+        : m_keySet(std::move(other.m_keySet))
+    {
+        for (size_t i = 0; i < NUMBITS; ++i)
+            m_bits[i] = std::move(other.m_bits[i]);
+    }
+
+    CSuperInt& operator = (const CSuperInt &other)
+    {
+        m_bits = other.m_bits;
+        m_keySet = other.m_keySet;
+        return *this;
+    }
+
+    CSuperInt& operator = (CSuperInt &&other)
+    {
+        for (size_t i = 0; i < NUMBITS; ++i)
+            m_bits[i] = std::move(other.m_bits[i]);
+        m_keySet = std::move(other.m_keySet);
+        return *this;
     }
 
     // decode value into binary for the given key
@@ -53,10 +233,7 @@ public:
     {
         size_t result = 0;
         for (size_t i = 0; i < NUMBITS; ++i)
-        {
-            TINT value = (m_bits[i] % key) % 2;
-            result = result | (value.convert_to<size_t>() << i);
-        }
+            result = result | (DecodeBit(m_bits[i], key, *m_keySet) << i);
         return result;
     }
 
@@ -89,7 +266,7 @@ public:
             return;
 
         for (size_t index = NUMBITS - 1; index >= amount; --index)
-            m_bits[index] = m_bits[index - amount];
+            m_bits[index] = std::move(m_bits[index - amount]);
 
         for (size_t index = 0; index < amount; ++index)
             m_bits[index] = 0;
@@ -100,10 +277,10 @@ public:
         if (amount == 0)
             return;
 
-        const TINT& signBit = IsNegative();
+        const TBIT signBit = IsNegative();
 
         for (size_t index = 0; index < NUMBITS - amount; ++index)
-            m_bits[index] = m_bits[index + amount];
+            m_bits[index] = std::move(m_bits[index + amount]);
 
         for (size_t index = NUMBITS - amount; index < NUMBITS; ++index)
             m_bits[index] = signBit;
@@ -113,32 +290,30 @@ public:
     void Negate ()
     {
         const CKeySet& keySet = *m_keySet;
-        for (TINT& bit : m_bits)
-            bit = NOT(bit, keySet);
+        for (TBIT& bit : m_bits)
+            NOTEQ(bit, keySet);
 
-        CSuperInt<NUMBITS> one(1, m_keySet);
-        *this = *this + one;
+        ++*this;
     }
 
-    void NegateConditional (const TINT& condition)
+    void NegateConditional (const TBIT& condition)
     {
         // To negate in two's complement, we flip the bits and then add 1.
         // This effectively multiplies by -1.
 
-        // make the adder here in case the condition is part of this int
+        // copy the condition in case it is part of this int
         // as is the case of when doing abs
-        CSuperInt<NUMBITS> add(m_keySet);
-        add.GetBit(0) = condition;
+        TBIT carry = condition;
 
         // Step 1 - negate by XORing every bit against the condition bit.
         // AKA negate bits conditionally.
-        for (TINT& v : m_bits)
-            v = XOR(v, condition, *m_keySet);
+        const CKeySet& keySet = *m_keySet;
+        for (TBIT& v : m_bits)
+            XOREQ(v, carry, keySet);
 
-        // Step 2 - add a number where the lowest bit is the condition bit.
+        // Step 2 - add the condition bit with a chain of half adders.
         // AKA add 1 conditionally.
-        CSuperInt<NUMBITS> tempTest(m_keySet);
-        *this = *this + add;
+        AddCarryIn(carry);
     }
 
     // absolute value.  Negate if the number is negative
@@ -147,8 +322,104 @@ public:
         NegateConditional(IsNegative());
     }
 
+    // In place math.  These don't copy either operand, so they only make the
+    // temporaries of the circuits themselves.
+    CSuperInt& operator += (const CSuperInt &b)
+    {
+        // ripple carry adder, starting with a carry of 0
+        const CKeySet& keySet = *m_keySet;
+        TBIT carryBit = 0;
+        for (size_t i = 0; i < NUMBITS; ++i)
+            FullAdderEQ(m_bits[i], b.GetBit(i), carryBit, keySet);
+        return *this;
+    }
+
+    CSuperInt& operator -= (const CSuperInt &b)
+    {
+        // a - b = a + NOT(b) + 1, so add the flipped bits of b with a carry in of 1
+        const CKeySet& keySet = *m_keySet;
+        TBIT carryBit = 1;
+        TBIT notB;
+        for (size_t i = 0; i < NUMBITS; ++i)
+        {
+            notB = b.GetBit(i);
+            NOTEQ(notB, keySet);
+            FullAdderEQ(m_bits[i], notB, carryBit, keySet);
+        }
+        return *this;
+    }
+
+    CSuperInt& operator *= (const CSuperInt &b)
+    {
+        *this = *this * b;
+        return *this;
+    }
+
+    CSuperInt& operator /= (const CSuperInt &b)
+    {
+        *this = *this / b;
+        return *this;
+    }
+
+    CSuperInt& operator %= (const CSuperInt &b)
+    {
+        *this = *this % b;
+        return *this;
+    }
+
+    CSuperInt& operator ++ ()
+    {
+        AddCarryIn(TBIT(1));
+        return *this;
+    }
+
+    CSuperInt& operator -- ()
+    {
+        // subtract 1 with a chain of half subtractors, starting with a borrow of 1
+        const CKeySet& keySet = *m_keySet;
+        TBIT borrow = 1;
+        TBIT nextBorrow;
+        for (TBIT& bit : m_bits)
+        {
+            nextBorrow = bit;
+            NOTEQ(nextBorrow, keySet);
+            ANDEQ(nextBorrow, borrow, keySet);
+            XOREQ(bit, borrow, keySet);
+            std::swap(borrow, nextBorrow);
+        }
+        return *this;
+    }
+
+    CSuperInt operator ++ (int)
+    {
+        CSuperInt ret(*this);
+        ++*this;
+        return ret;
+    }
+
+    CSuperInt operator -- (int)
+    {
+        CSuperInt ret(*this);
+        --*this;
+        return ret;
+    }
+
+    // adds a single bit to the lowest bit, with a chain of half adders
+    void AddCarryIn (TBIT carry)
+    {
+        const CKeySet& keySet = *m_keySet;
+        TBIT nextCarry;
+        for (TBIT& bit : m_bits)
+        {
+            nextCarry = bit;
+            ANDEQ(nextCarry, carry, keySet);
+            XOREQ(bit, carry, keySet);
+            std::swap(carry, nextCarry);
+        }
+    }
+
     // returns a superpositional value for whether or not this number is negative
-    const TINT& IsNegative() const { return *m_bits.rbegin(); }
+    const TBIT& IsNegative() const { return *m_bits.rbegin(); }
 
     // Internals Access
     size_t MaxError(const TINT& key) const
@@ -156,7 +427,7 @@ public:
         float maxError = 0.0f;
         for (size_t i = 0; i < NUMBITS; ++i)
         {
-            TINT residue = GetBit(i) % key;
+            TINT residue = BitToTINT(GetBit(i), *m_keySet) % key;
             float error = residue.convert_to<float>() / key.convert_to<float>();
             if (error > maxError)
                 maxError = error;
@@ -164,13 +435,13 @@ public:
         return size_t(maxError * 100.0f);
     }
 
-    const TINT& GetBit(size_t i) const { return m_bits[i]; }
-    TINT& GetBit(size_t i) { return m_bits[i]; }
+    const TBIT& GetBit(size_t i) const { return m_bits[i]; }
+    TBIT& GetBit(size_t i) { return m_bits[i]; }
 
-    const std::array<TINT, NUMBITS>& GetBits () const {
+    const std::array<TBIT, NUMBITS>& GetBits () const {
         return m_bits;
     }
-    std::array<TINT, NUMBITS>& GetBits() {
+    std::array<TBIT, NUMBITS>& GetBits() {
         return m_bits;
     }
 
@@ -197,177 +468,175 @@ public:
     static const size_t c_mask = (1 << NUMBITS) - 1;
     static const size_t c_numBits = NUMBITS;
 
+    typedef TBIT TBit;
+
 // private members
 private:
-    std::array<TINT, NUMBITS>   m_bits;     // the superpositional bits
+    std::array<TBIT, NUMBITS>   m_bits;     // the superpositional bits
     std::shared_ptr<CKeySet>    m_keySet;   // the keys to decode the bits
 
-    static const TINT           s_zeroBit;
+    static const TBIT           s_zeroBit;
 };
 
-template <size_t NUMBITS>
-const TINT CSuperInt<NUMBITS>::s_zeroBit = 0;
+template <size_t NUMBITS, typename TBIT>
+const TBIT CSuperInt<NUMBITS, TBIT>::s_zeroBit = 0;
 
 //=================================================================================
-// HE operations
-//=================================================================================
-inline TINT XOR (const TINT &A, const TINT &B, const CKeySet &keySet)
-{
-    TINT result = A + B;
-    keySet.ReduceValue(TINT(result));
-    return result;
-}
-
+// Math operations
 //=================================================================================
-inline TINT AND(const TINT &A, const TINT &B, const CKeySet &keySet)
+template <size_t NUMBITS, typename TBIT>
+CSuperInt<NUMBITS, TBIT> operator + (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
-    TINT result = A * B;
-    keySet.ReduceValue(result);
+    CSuperInt<NUMBITS, TBIT> result(a);
+    result += b;
     return result;
 }
 
 //=================================================================================
-inline TINT NOT(const TINT &A, const CKeySet &keySet)
+template <size_t NUMBITS, typename TBIT>
+CSuperInt<NUMBITS, TBIT> operator + (CSuperInt<NUMBITS, TBIT> &&a, const CSuperInt<NUMBITS, TBIT> &b)
 {
-    return XOR(A, TINT(1), keySet);
+    a += b;
+    return std::move(a);
 }
 
 //=================================================================================
-// Math operations
-//=================================================================================
-inline TINT FullAdder(const TINT &A, const TINT &B, TINT &carryBit, const CKeySet &keySet)
+template <size_t NUMBITS, typename TBIT>
+CSuperInt<NUMBITS, TBIT> operator - (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
-    // homomorphically add the encrypted bits A and B
-    // return the single bit sum, and put the carry bit into carryBit
-    // From http://en.wikipedia.org/w/index.php?title=Adder_(electronics)&oldid=381607326#Full_adder
-    TINT sumBit = XOR(XOR(A, B, keySet), carryBit, keySet);
-    carryBit = XOR(AND(A, B, keySet), AND(carryBit, XOR(A, B, keySet), keySet), keySet);
-    return sumBit;
-}
-
-//=================================================================================
-template <size_t NUMBITS>
-CSuperInt<NUMBITS> operator + (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
-{
-    // we initialize the carry bit to 0, not a superpositional value
-    TINT carryBit = 0;
-
-    // do the adding and return the result
-    const std::shared_ptr<CKeySet>& keySetPointer = a.GetKeySet();
-    const CKeySet& keySet = *keySetPointer;
-    CSuperInt<NUMBITS> result(keySetPointer);
-    for (size_t i = 0; i < NUMBITS; ++i)
-        result.GetBit(i) = FullAdder(a.GetBit(i), b.GetBit(i), carryBit, keySet);
+    CSuperInt<NUMBITS, TBIT> result(a);
+    result -= b;
     return result;
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-CSuperInt<NUMBITS> operator - (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+CSuperInt<NUMBITS, TBIT> operator - (CSuperInt<NUMBITS, TBIT> &&a, const CSuperInt<NUMBITS, TBIT> &b)
 {
-    CSuperInt<NUMBITS> negativeB(b);
-    negativeB.Negate();
-    return a + negativeB;
+    a -= b;
+    return std::move(a);
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-CSuperInt<NUMBITS> operator * (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+CSuperInt<NUMBITS, TBIT> operator * (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
     // do multiplication like this:
     // https://en.wikipedia.org/wiki/Binary_multiplier#Multiplication_basics
     const std::shared_ptr<CKeySet>& keySetPointer = a.GetKeySet();
     const CKeySet& keySet = *keySetPointer;
-    CSuperInt<NUMBITS> result(keySetPointer);
-    for (size_t i = 0; i < NUMBITS; ++i)
+    CSuperInt<NUMBITS, TBIT> result(keySetPointer);
     {
-        CSuperInt<NUMBITS> row = b;
-        for (TINT &v : row.GetBits())
-            v = AND(v, a.GetBit(i), keySet);
-
-        row.ShiftLeft(i);
-        result = result + row;
+        // the partial sums are temporaries, so they come from an arena
+        CTINTArenaScope arena;
+        CSuperInt<NUMBITS, TBIT> sum(keySetPointer);
+        TBIT rowBit;
+        for (size_t i = 0; i < NUMBITS; ++i)
+        {
+            // Add row i, which is b AND a[i] shifted left by i.  The low i bits of the
+            // row are 0, so adding them wouldn't change the sum, and the row's bits are
+            // made one at a time as they are added instead of copying b.
+            TBIT carryBit = 0;
+            for (size_t j = i; j < NUMBITS; ++j)
+            {
+                rowBit = b.GetBit(j - i);
+                ANDEQ(rowBit, a.GetBit(i), keySet);
+                FullAdderEQ(sum.GetBit(j), rowBit, carryBit, keySet);
+            }
+        }
+        arena.Escape(sum, result);
     }
     return result;
 }
 
+
 //=================================================================================
-template <size_t NUMBITS>
-CSuperInt<NUMBITS> operator / (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+CSuperInt<NUMBITS, TBIT> operator / (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
-    CSuperInt<NUMBITS> Q(a.GetKeySet());
-    CSuperInt<NUMBITS> R(a.GetKeySet());
-
-    Divide(a, b, Q, R);
-    return Q;
+    CSuperInt<NUMBITS, TBIT> result(a.GetKeySet());
+    {
+        // all of the division circuit's temporaries come from an arena
+        CTINTArenaScope arena;
+        CSuperInt<NUMBITS, TBIT> Q(a.GetKeySet());
+        CSuperInt<NUMBITS, TBIT> R(a.GetKeySet());
+        Divide(a, b, Q, R);
+        arena.Escape(Q, result);
+    }
+    return result;
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-CSuperInt<NUMBITS> operator % (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+CSuperInt<NUMBITS, TBIT> operator % (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
-    CSuperInt<NUMBITS> Q(a.GetKeySet());
-    CSuperInt<NUMBITS> R(a.GetKeySet());
-
-    Divide(a, b, Q, R);
-    return R;
+    CSuperInt<NUMBITS, TBIT> result(a.GetKeySet());
+    {
+        // all of the division circuit's temporaries come from an arena
+        CTINTArenaScope arena;
+        CSuperInt<NUMBITS, TBIT> Q(a.GetKeySet());
+        CSuperInt<NUMBITS, TBIT> R(a.GetKeySet());
+        Divide(a, b, Q, R);
+        arena.Escape(R, result);
+    }
+    return result;
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-TINT operator < (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+TBIT operator < (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
-    CSuperInt<NUMBITS> result(a.GetKeySet());
-    result = a - b;
+    CSuperInt<NUMBITS, TBIT> result(a);
+    result -= b;
     return result.IsNegative();
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-TINT operator <= (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+TBIT operator <= (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
     return NOT(a > B, *a.GetKeySet());
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-TINT operator > (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+TBIT operator > (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
-    CSuperInt<NUMBITS> result(a.GetKeySet());
-    result = b - a;
+    CSuperInt<NUMBITS, TBIT> result(b);
+    result -= a;
     return result.IsNegative();
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-TINT operator >= (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+TBIT operator >= (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
     return NOT(a < b, *a.GetKeySet());
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-TINT operator == (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+TBIT operator == (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
     const CKeySet& keySet = *a.GetKeySet();
-    TINT ANotLtB = NOT(a < b, keySet);
-    TINT BNotLtA = NOT(b < a, keySet);
+    TBIT ANotLtB = NOT(a < b, keySet);
+    TBIT BNotLtA = NOT(b < a, keySet);
     return AND(ANotLtB, BNotLtA, keySet);
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-TINT operator != (const CSuperInt<NUMBITS> &a, const CSuperInt<NUMBITS> &b)
+template <size_t NUMBITS, typename TBIT>
+TBIT operator != (const CSuperInt<NUMBITS, TBIT> &a, const CSuperInt<NUMBITS, TBIT> &b)
 {
     const CKeySet& keySet = *a.GetKeySet();
-    TINT ALtB = a < b;
-    TINT BLtA = b < a;
+    TBIT ALtB = a < b;
+    TBIT BLtA = b < a;
     return OR(ALtB, BLtA, keySet);
 }
 
 //=================================================================================
-template <size_t NUMBITS>
-void Divide (const CSuperInt<NUMBITS> &Nin, const CSuperInt<NUMBITS> &Din, CSuperInt<NUMBITS> &Q, CSuperInt<NUMBITS> &R)
+template <size_t NUMBITS, typename TBIT>
+void Divide (const CSuperInt<NUMBITS, TBIT> &Nin, const CSuperInt<NUMBITS, TBIT> &Din, CSuperInt<NUMBITS, TBIT> &Q, CSuperInt<NUMBITS, TBIT> &R)
 {
     // Unsigned integer division algorithm from here: 
     // https://en.wikipedia.org/wiki/Division_algorithm#Integer_division_.28unsigned.29_with_remainder
@@ -378,14 +647,15 @@ void Divide (const CSuperInt<NUMBITS> &Nin, const CSuperInt<NUMBITS> &Din, CSupe
     R.SetInt(0);
 
     // Make N and D positive, making sure to remember what their sign used to be
-    CSuperInt<NUMBITS> N(Nin);
-    CSuperInt<NUMBITS> D(Din);
-    TINT NWasNegative = N.IsNegative();
-    TINT DWasNegative = D.IsNegative();
+    CSuperInt<NUMBITS, TBIT> N(Nin);
+    CSuperInt<NUMBITS, TBIT> D(Din);
+    TBIT NWasNegative = N.IsNegative();
+    TBIT DWasNegative = D.IsNegative();
     N.Abs();
     D.Abs();
 
     const CKeySet& keySet = *N.GetKeySet();
+    CSuperInt<NUMBITS, TBIT> difference(N.GetKeySet());
     for (size_t index = NUMBITS; index > 0; --index)
     {
         size_t i = index - 1;
@@ -396,27 +666,33 @@ void Divide (const CSuperInt<NUMBITS> &Nin, const CSuperInt<NUMBITS> &Din, CSupe
         // R = R - D
         // Q[i] = 1
         {
-            // if R >= D
-            TINT RgteD = R >= D;
-
-            // R = R - D
-            CSuperInt<NUMBITS> branchlessMultiplier(N.GetKeySet());
-            branchlessMultiplier.GetBit(0) = RgteD;
-            CSuperInt<NUMBITS> subtractD(D);
-            subtractD = D * branchlessMultiplier;
-            R = R - subtractD;
+            // if R >= D.  R >= D is NOT(R - D < 0), so keep R - D around to use below.
+            difference = R;
+            difference -= D;
+            TBIT RgteD = NOT(difference.IsNegative(), keySet);
+
+            // R = R - D, done branchlessly by selecting between R and R - D per bit:
+            // R = R XOR (RgteD AND (R XOR (R - D)))
+            for (size_t bitIndex = 0; bitIndex < NUMBITS; ++bitIndex)
+            {
+                TBIT &RBit = R.GetBit(bitIndex);
+                TBIT &select = difference.GetBit(bitIndex);
+                XOREQ(select, RBit, keySet);
+                ANDEQ(select, RgteD, keySet);
+                XOREQ(RBit, select, keySet);
+            }
 
             // Q[i] = 1
-            Q.GetBit(i) = RgteD;
+            Q.GetBit(i) = std::move(RgteD);
         }
     }
 
     // Make dividedend and remainder have same sign
-    TINT RIsNegative = R.IsNegative();
-    TINT NRNegativeMismatch = XOR(NWasNegative, RIsNegative, keySet);
+    TBIT RIsNegative = R.IsNegative();
+    TBIT NRNegativeMismatch = XOR(NWasNegative, RIsNegative, keySet);
     R.NegateConditional(NRNegativeMismatch);
 
     // Make quotient negative if signs disagree
-    TINT quotientNegative = XOR(NWasNegative, DWasNegative, keySet);
+    TBIT quotientNegative = XOR(NWasNegative, DWasNegative, keySet);
     Q.NegateConditional(quotientNegative);
 }
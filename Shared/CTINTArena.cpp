@@ -0,0 +1,199 @@
+//=================================================================================
+//
+//  CTINTArena
+//
+//  A pool allocator for TINT limbs
+//
+//=================================================================================
+
+#include "CTINTArena.h"
+#include "Macros.h"
+#include <new>
+
+#ifdef _MSC_VER
+    #define THREAD_LOCAL_POD __declspec(thread)
+#else
+    #define THREAD_LOCAL_POD __thread
+#endif
+
+// every block starts with a header saying where it came from, so Free() works on
+// blocks from the heap and from any arena
+struct SArenaBlockHeader
+{
+    CTINTArena* m_arena;        // nullptr for the heap
+    size_t      m_sizeClass;
+};
+static const size_t c_headerBytes = 16;
+static_assert(sizeof(SArenaBlockHeader) <= c_headerBytes, "arena block header too large");
+
+static THREAD_LOCAL_POD CTINTArena* s_currentArena = nullptr;
+static THREAD_LOCAL_POD size_t s_numAllocations = 0;
+static std::atomic<size_t> s_peakSlabBytes(0);
+
+//=================================================================================
+// block sizes are powers of 2, starting at 32 bytes
+static size_t SizeClass (size_t bytes)
+{
+    size_t sizeClass = 0;
+    while ((size_t(32) << sizeClass) < bytes)
+        ++sizeClass;
+    return sizeClass;
+}
+
+//=================================================================================
+CTINTArena::CTINTArena ()
+    : m_cursor(nullptr)
+    , m_slabEnd(nullptr)
+    , m_slabBytes(0)
+    , m_liveBytes(0)
+    , m_peakLiveBytes(0)
+    , m_liveAllocations(0)
+{
+    m_freeLists.fill(nullptr);
+}
+
+//=================================================================================
+CTINTArena::~CTINTArena ()
+{
+    for (char* slab : m_slabs)
+        ::operator delete(slab);
+}
+
+//=================================================================================
+void* CTINTArena::Allocate (size_t bytes)
+{
+    const size_t c_sizeClass = SizeClass(bytes);
+    CTINTArena* arena = s_currentArena;
+    ++s_numAllocations;
+
+    SArenaBlockHeader* header;
+    if (arena != nullptr)
+        header = (SArenaBlockHeader*)arena->AllocateBlock(c_sizeClass);
+    else
+        header = (SArenaBlockHeader*)::operator new(c_headerBytes + bytes);
+
+    header->m_arena = arena;
+    header->m_sizeClass = c_sizeClass;
+    return (char*)header + c_headerBytes;
+}
+
+//=================================================================================
+void CTINTArena::Free (void* p)
+{
+    if (p == nullptr)
+        return;
+
+    SArenaBlockHeader* header = (SArenaBlockHeader*)((char*)p - c_headerBytes);
+    CTINTArena* arena = header->m_arena;
+    if (arena == nullptr)
+    {
+        ::operator delete(header);
+        return;
+    }
+
+    // The free lists belong to the arena's thread.  Blocks freed from other threads
+    // aren't reused, they are released with the rest of the arena.
+    --arena->m_liveAllocations;
+    if (arena == s_currentArena)
+        arena->FreeBlock(header, header->m_sizeClass);
+}
+
+//=================================================================================
+CTINTArena* CTINTArena::GetCurrent ()
+{
+    return s_currentArena;
+}
+
+//=================================================================================
+void CTINTArena::SetCurrent (CTINTArena* arena)
+{
+    s_currentArena = arena;
+}
+
+//=================================================================================
+size_t CTINTArena::GetPeakSlabBytes ()
+{
+    return s_peakSlabBytes;
+}
+
+//=================================================================================
+void CTINTArena::ResetPeakSlabBytes ()
+{
+    s_peakSlabBytes = 0;
+}
+
+//=================================================================================
+size_t CTINTArena::GetNumAllocations ()
+{
+    return s_numAllocations;
+}
+
+//=================================================================================
+void* CTINTArena::AllocateBlock (size_t sizeClass)
+{
+    const size_t c_blockBytes = c_headerBytes + (size_t(32) << sizeClass);
+    ++m_liveAllocations;
+    m_liveBytes += c_blockBytes;
+    if (m_liveBytes > m_peakLiveBytes)
+        m_peakLiveBytes = m_liveBytes;
+
+    void* block = m_freeLists[sizeClass];
+    if (block != nullptr)
+    {
+        m_freeLists[sizeClass] = *(void**)block;
+        return block;
+    }
+
+    if (size_t(m_slabEnd - m_cursor) < c_blockBytes)
+    {
+        // big blocks get a slab of their own, so the current slab can keep being used
+        const size_t c_newSlabBytes = c_blockBytes > c_slabBytes / 4 ? c_blockBytes : c_slabBytes;
+        char* slab = (char*)::operator new(c_newSlabBytes);
+        m_slabs.push_back(slab);
+        m_slabBytes += c_newSlabBytes;
+
+        size_t peak = s_peakSlabBytes;
+        while (peak < m_slabBytes && !s_peakSlabBytes.compare_exchange_weak(peak, m_slabBytes));
+
+        if (c_newSlabBytes != c_slabBytes)
+            return slab;
+        m_cursor = slab;
+        m_slabEnd = slab + c_newSlabBytes;
+    }
+
+    block = m_cursor;
+    m_cursor += c_blockBytes;
+    return block;
+}
+
+//=================================================================================
+void CTINTArena::FreeBlock (void* block, size_t sizeClass)
+{
+    m_liveBytes -= c_headerBytes + (size_t(32) << sizeClass);
+    *(void**)block = m_freeLists[sizeClass];
+    m_freeLists[sizeClass] = block;
+}
+
+//=================================================================================
+CTINTArenaScope::CTINTArenaScope ()
+    : m_previous(CTINTArena::GetCurrent())
+    , m_arena(nullptr)
+{
+    if (m_previous == nullptr)
+    {
+        m_arena = new CTINTArena;
+        CTINTArena::SetCurrent(m_arena);
+    }
+}
+
+//=================================================================================
+CTINTArenaScope::~CTINTArenaScope ()
+{
+    if (m_arena == nullptr)
+        return;
+
+    // anything still alive would be left pointing at freed memory
+    Assert_(m_arena->GetLiveAllocations() == 0);
+    CTINTArena::SetCurrent(m_previous);
+    delete m_arena;
+}
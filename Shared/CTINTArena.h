@@ -0,0 +1,151 @@
+//=================================================================================
+//
+//  CTINTArena
+//
+//  A pool allocator for TINT limbs.  While a CTINTArenaScope is alive, every TINT
+//  allocation on that thread comes out of the scope's arena: blocks are bump
+//  allocated from 64KB slabs, freed blocks go on a free list for their size (sizes
+//  are rounded up to a power of 2), and all slabs are released at once when the
+//  scope ends.  Outside of a scope, allocations come from the heap.
+//
+//  This is plugged into cpp_int as its allocator (see TINT_USE_ARENA() in TINT.h),
+//  so a circuit evaluation like CSuperInt's operator / does no heap allocations for
+//  its temporaries once the arena has warmed up.
+//
+//  Anything that outlives the scope must be copied out with CTINTArenaScope::Escape().
+//
+//=================================================================================
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <atomic>
+#include <stddef.h>
+
+class CTINTArena
+{
+public:
+    CTINTArena ();
+    ~CTINTArena ();
+
+    // allocates from the current thread's arena if it has one, else from the heap
+    static void* Allocate (size_t bytes);
+
+    // frees a block from Allocate(), from any thread
+    static void Free (void* p);
+
+    // the arena allocations on this thread come from, or nullptr for the heap
+    static CTINTArena* GetCurrent ();
+    static void SetCurrent (CTINTArena* arena);
+
+    size_t GetSlabBytes () const { return m_slabBytes; }
+    size_t GetLiveBytes () const { return m_liveBytes; }
+    size_t GetPeakLiveBytes () const { return m_peakLiveBytes; }
+    size_t GetLiveAllocations () const { return m_liveAllocations; }
+
+    // the most slab memory any one arena has had, across all threads
+    static size_t GetPeakSlabBytes ();
+    static void ResetPeakSlabBytes ();
+
+    // how many allocations this thread has made, from arenas and from the heap
+    static size_t GetNumAllocations ();
+
+private:
+    void* AllocateBlock (size_t sizeClass);
+    void FreeBlock (void* block, size_t sizeClass);
+
+    static const size_t c_slabBytes = 64 * 1024;
+    static const size_t c_numSizeClasses = 64;
+
+    std::vector<char*>                          m_slabs;
+    char*                                       m_cursor;
+    char*                                       m_slabEnd;
+    std::array<void*, c_numSizeClasses>         m_freeLists;
+
+    size_t                                      m_slabBytes;
+    size_t                                      m_liveBytes;
+    size_t                                      m_peakLiveBytes;
+    std::atomic<size_t>                         m_liveAllocations;
+};
+
+//=================================================================================
+// Makes an arena current on this thread for its lifetime.  Scopes nest: an inner
+// scope keeps using the outer scope's arena, so only the outermost scope releases
+// memory.
+//=================================================================================
+class CTINTArenaScope
+{
+public:
+    CTINTArenaScope ();
+    ~CTINTArenaScope ();
+
+    // copies a value that needs to outlive this scope, allocating it from wherever
+    // allocations came from before the scope started
+    template <typename T>
+    void Escape (const T& from, T& to)
+    {
+        if (m_arena == nullptr)
+        {
+            to = from;
+            return;
+        }
+        CTINTArena::SetCurrent(m_previous);
+        to = from;
+        CTINTArena::SetCurrent(m_arena);
+    }
+
+    // null if this scope is nested inside another one
+    const CTINTArena* GetArena () const { return m_arena; }
+
+private:
+    CTINTArenaScope (const CTINTArenaScope&);
+    CTINTArenaScope& operator = (const CTINTArenaScope&);
+
+    CTINTArena*     m_previous;
+    CTINTArena*     m_arena;
+};
+
+//=================================================================================
+// Standard allocator interface over CTINTArena, for boost::multiprecision backends
+//=================================================================================
+template <typename T>
+class CTINTArenaAllocator
+{
+public:
+    typedef T               value_type;
+    typedef T*              pointer;
+    typedef const T*        const_pointer;
+    typedef T&              reference;
+    typedef const T&        const_reference;
+    typedef size_t          size_type;
+    typedef ptrdiff_t       difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef CTINTArenaAllocator<U> other;
+    };
+
+    CTINTArenaAllocator () {}
+
+    template <typename U>
+    CTINTArenaAllocator (const CTINTArenaAllocator<U>&) {}
+
+    pointer allocate (size_type count, const void* = 0) { return (pointer)CTINTArena::Allocate(count * sizeof(T)); }
+    void deallocate (pointer p, size_type) { CTINTArena::Free(p); }
+
+    size_type max_size () const { return size_type(-1) / sizeof(T) / 2; }
+
+    void construct (pointer p, const T& value) { new((void*)p) T(value); }
+    void destroy (pointer p) { p->~T(); }
+
+    pointer address (reference x) const { return &x; }
+    const_pointer address (const_reference x) const { return &x; }
+};
+
+template <typename T, typename U>
+bool operator == (const CTINTArenaAllocator<T>&, const CTINTArenaAllocator<U>&) { return true; }
+
+template <typename T, typename U>
+bool operator != (const CTINTArenaAllocator<T>&, const CTINTArenaAllocator<U>&) { return false; }
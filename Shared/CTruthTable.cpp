@@ -0,0 +1,43 @@
+//=================================================================================
+//
+//  CTruthTable
+//
+//  A superpositional value decoded for every key at once
+//
+//=================================================================================
+
+#include "CTruthTable.h"
+#include <cmath>
+
+//=================================================================================
+size_t CTruthTable::DecodeBinary (size_t keyIndex) const
+{
+    size_t result = 0;
+    for (size_t i = 0, c = m_bits.size(); i < c; ++i)
+        result = result | (DecodeBit(i, keyIndex) << i);
+    return result;
+}
+
+//=================================================================================
+int CTruthTable::DecodeInt (size_t keyIndex) const
+{
+    // two's complement, same as CSuperInt::IntFromBinary
+    const size_t c_numBits = m_bits.size();
+    if (c_numBits == 0)
+        return 0;
+    const size_t c_mask = (size_t(1) << c_numBits) - 1;
+    const size_t c_negativeTestMask = size_t(1) << (c_numBits - 1);
+    size_t n = DecodeBinary(keyIndex);
+    if (n & c_negativeTestMask)
+        return -(int)((n ^ c_mask) + 1);
+    else
+        return int(n);
+}
+
+//=================================================================================
+float CTruthTable::DecodeFloat (size_t keyIndex) const
+{
+    // fixed point, same as CSuperFixed::DecodeFloat
+    const float c_intToFloat = 1.0f / std::pow(2.0f, (float)m_numFractionBits);
+    return ((float)DecodeInt(keyIndex)) * c_intToFloat;
+}
@@ -0,0 +1,60 @@
+//=================================================================================
+//
+//  CTruthTable
+//
+//  A superpositional value decoded for every key at once.  Each bit of the value is
+//  stored as a packed bitset with one bit per key, 64 keys to a word, made with a
+//  single batch decode per bit (see CKeySet::DecodeAllKeys) instead of a bigint
+//  mod per bit per key.
+//
+//=================================================================================
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "CSuperInt.h"
+#include "CSuperFixed.h"
+
+class CTruthTable
+{
+public:
+    CTruthTable () : m_numKeys(0), m_numFractionBits(0) {}
+
+    template <size_t NUMBITS, typename TBIT>
+    explicit CTruthTable (const CSuperInt<NUMBITS, TBIT> &value)
+        : m_numKeys(value.GetKeySet()->GetKeys().size())
+        , m_numFractionBits(0)
+    {
+        DecodeBitsAllKeys(value.GetBits().data(), NUMBITS, *value.GetKeySet(), m_bits);
+    }
+
+    template <size_t BITS_INTEGER, size_t BITS_FRACTION, typename TBIT>
+    explicit CTruthTable (const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> &value)
+        : m_numKeys(value.GetKeySet()->GetKeys().size())
+        , m_numFractionBits(BITS_FRACTION)
+    {
+        DecodeBitsAllKeys(value.GetBits().data(), BITS_INTEGER + BITS_FRACTION, *value.GetKeySet(), m_bits);
+    }
+
+    size_t GetNumKeys () const { return m_numKeys; }
+    size_t GetNumBits () const { return m_bits.size(); }
+
+    // the packed bitset for one bit of the value: bit k is the value of the bit for key k
+    const std::vector<uint64_t> &GetPackedBit (size_t bitIndex) const { return m_bits[bitIndex]; }
+
+    // views of the value for a specific key, like the CSuperInt and CSuperFixed decode functions
+    size_t DecodeBit (size_t bitIndex, size_t keyIndex) const
+    {
+        return size_t(m_bits[bitIndex][keyIndex / 64] >> (keyIndex % 64)) & 1;
+    }
+
+    size_t DecodeBinary (size_t keyIndex) const;
+    int DecodeInt (size_t keyIndex) const;
+    float DecodeFloat (size_t keyIndex) const;
+
+private:
+    std::vector<std::vector<uint64_t>>  m_bits;
+    size_t                              m_numKeys;
+    size_t                              m_numFractionBits;
+};
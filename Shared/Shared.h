@@ -4,25 +4,28 @@
 #include <algorithm>
 #include "CSuperInt.h"
 #include "CSuperFixed.h"
+#include "CTruthTable.h"
 #include "Macros.h"
 
 void WaitForEnter ();
 
 //=================================================================================
-template <size_t NUMBITS>
-void ReportBitsAndError(const CSuperInt<NUMBITS> &superInt)
+template <size_t NUMBITS, typename TBIT>
+void ReportBitsAndError(const CSuperInt<NUMBITS, TBIT> &superInt)
 {
-    const std::array<TINT, NUMBITS> &bits = superInt.GetBits();
-    const std::vector<TINT> &keys = superInt.GetKeySet()->GetKeys();
+    const std::array<TBIT, NUMBITS> &bits = superInt.GetBits();
+    const CKeySet &keySet = *superInt.GetKeySet();
+    const std::vector<TINT> &keys = keySet.GetKeys();
 
     for (size_t i = 0; i < NUMBITS; ++i)
     {
-        std::cout << "--Bit " << i << "--\n" << bits[i] << "\n";
+        TINT bit = BitToTINT(bits[i], keySet);
+        std::cout << "--Bit " << i << "--\n" << bit << "\n";
 
         float maxError = 0.0f;
         for (int keyIndex = 0, keyCount = keys.size(); keyIndex < keyCount; ++keyIndex)
         {
-            TINT residue = bits[i] % keys[keyIndex];
+            TINT residue = bit % keys[keyIndex];
             float error = 100.0f * residue.convert_to<float>() / keys[keyIndex].convert_to<float>();
             if (error > maxError)
                 maxError = error;
@@ -32,16 +35,19 @@ void ReportBitsAndError(const CSuperInt<NUMBITS> &superInt)
 }
 
 //=================================================================================
-template <size_t BITS_INTEGER, size_t BITS_FRACTION>
-void ReportBitsAndError(const CSuperFixed<BITS_INTEGER, BITS_FRACTION> &superFixed)
+template <size_t BITS_INTEGER, size_t BITS_FRACTION, typename TBIT>
+void ReportBitsAndError(const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> &superFixed)
 {
     ReportBitsAndError(superFixed.GetInternalInt());
 }
 
 //=================================================================================
-template <typename L, size_t NUMBITS>
-bool PermuteResults2Inputs(const CSuperInt<NUMBITS> &A, const CSuperInt<NUMBITS> &B, const CSuperInt<NUMBITS> &superResult, const std::vector<TINT> &keys, const L& lambda)
+template <typename L, size_t NUMBITS, typename TBIT>
+bool PermuteResults2Inputs(const CSuperInt<NUMBITS, TBIT> &A, const CSuperInt<NUMBITS, TBIT> &B, const CSuperInt<NUMBITS, TBIT> &superResult, const std::vector<TINT> &keys, const L& lambda)
 {
+    // decode the result for every key at once
+    CTruthTable truthTable(superResult);
+
     bool ret = true;
     for (size_t b = 0, bc = (1 << NUMBITS) - 1; b <= bc; ++b)
     {
@@ -50,8 +56,8 @@ bool PermuteResults2Inputs(const CSuperInt<NUMBITS> &A, const CSuperInt<NUMBITS>
             // get the index of our key for this specific set of inputs
             size_t keyIndex = (b << NUMBITS) | a;
 
-            // decode result for this specific key
-            size_t result = superResult.DecodeBinary(keys[keyIndex]);
+            // get the result for this specific key
+            size_t result = truthTable.DecodeBinary(keyIndex);
 
             // call the lambda!
             ret = ret && lambda(a, b, keyIndex, keys[keyIndex], result);
@@ -61,8 +67,8 @@ bool PermuteResults2Inputs(const CSuperInt<NUMBITS> &A, const CSuperInt<NUMBITS>
 }
 
 //=================================================================================
-template <typename L, size_t BITS_INTEGER, size_t BITS_FRACTION>
-bool PermuteResults2Inputs(const CSuperFixed<BITS_INTEGER, BITS_FRACTION> &A, const CSuperFixed<BITS_INTEGER, BITS_FRACTION> &B, const CSuperFixed<BITS_INTEGER, BITS_FRACTION> &superResult, const std::vector<TINT> &keys, const L& lambda)
+template <typename L, size_t BITS_INTEGER, size_t BITS_FRACTION, typename TBIT>
+bool PermuteResults2Inputs(const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> &A, const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> &B, const CSuperFixed<BITS_INTEGER, BITS_FRACTION, TBIT> &superResult, const std::vector<TINT> &keys, const L& lambda)
 {
     return PermuteResults2Inputs(A.GetInternalInt(), B.GetInternalInt(), superResult.GetInternalInt(), keys, lambda);
 }
\ No newline at end of file
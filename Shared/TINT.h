@@ -1,12 +1,101 @@
 #pragma once
 
+#include <vector>
+#include <stdint.h>
+#include <iterator>
+
+// The library TINT comes from.  Change the default here, or define TINT_BACKEND in the
+// compiler's preprocessor definitions to build every project with the same backend.
+// GMP and libtommath need their libraries linked in (MPIR provides gmp.h on windows).
+#define TINT_BACKEND_CPP_INT    0
+#define TINT_BACKEND_GMP        1
+#define TINT_BACKEND_TOMMATH    2
+
+#ifndef TINT_BACKEND
+#define TINT_BACKEND TINT_BACKEND_CPP_INT
+#endif
+
+// if TINT_USE_ARENA() is 1, cpp_int limbs are allocated with CTINTArena, which makes
+// temporaries inside a CTINTArenaScope come from a pool instead of the heap.
+#define TINT_USE_ARENA() 1
+
 #include <boost/multiprecision/cpp_int.hpp>
-//#include <boost/multiprecision/tommath.hpp>
-//#include <boost/multiprecision/gmp.hpp>
+#include "CTINTArena.h"
+
+#if TINT_BACKEND == TINT_BACKEND_GMP
+    #include <boost/multiprecision/gmp.hpp>
+    #ifdef _MSC_VER
+        #pragma comment(lib, "mpir.lib")
+    #endif
+    typedef boost::multiprecision::mpz_int TINT;
+    #define TINT_BACKEND_NAME "gmp"
+#elif TINT_BACKEND == TINT_BACKEND_TOMMATH
+    #include <boost/multiprecision/tommath.hpp>
+    #ifdef _MSC_VER
+        #pragma comment(lib, "tommath.lib")
+    #endif
+    typedef boost::multiprecision::tom_int TINT;
+    #define TINT_BACKEND_NAME "tommath"
+#else
+    //typedef int64_t TINT;
+    //typedef boost::multiprecision::int128_t TINT;
+    #if TINT_USE_ARENA()
+        typedef boost::multiprecision::number<
+            boost::multiprecision::cpp_int_backend<
+                0, 0,
+                boost::multiprecision::signed_magnitude,
+                boost::multiprecision::unchecked,
+                CTINTArenaAllocator<boost::multiprecision::limb_type>
+            >
+        > TINT;
+    #else
+        typedef boost::multiprecision::cpp_int TINT;
+    #endif
+    #define TINT_BACKEND_NAME "cpp_int"
+#endif
 
-//typedef int64_t TINT;
-//typedef boost::multiprecision::int128_t TINT;
-//typedef boost::multiprecision::gmp_int TINT;
-//typedef boost::multiprecision::tom_int TINT;
-typedef boost::multiprecision::cpp_int TINT;
+//=================================================================================
+// The magnitude of a TINT as 64 bit limbs, least significant first, with no limbs for 0.  export_bits()
+// and import_bits() only work with cpp_int, so the other backends use their own.
+//=================================================================================
+inline void TINTToLimbs (const TINT &value, std::vector<uint64_t> &limbs)
+{
+    limbs.clear();
+    #if TINT_BACKEND == TINT_BACKEND_GMP
+        const mpz_srcptr z = value.backend().data();
+        limbs.resize((mpz_sizeinbase(z, 2) + 63) / 64);
+        size_t count = 0;
+        mpz_export(limbs.data(), &count, -1, sizeof(uint64_t), 0, 0, z);
+        limbs.resize(count);
+    #elif TINT_BACKEND == TINT_BACKEND_TOMMATH
+        TINT v = boost::multiprecision::abs(value);
+        while (v != 0)
+        {
+            limbs.push_back(TINT(v & UINT64_MAX).convert_to<uint64_t>());
+            v >>= 64;
+        }
+    #else
+        if (value != 0)
+            boost::multiprecision::export_bits(value, std::back_inserter(limbs), 64, false);
+    #endif
+}
 
+//=================================================================================
+inline TINT TINTFromLimbs (const uint64_t *limbs, size_t numLimbs)
+{
+    TINT ret = 0;
+    if (numLimbs == 0)
+        return ret;
+    #if TINT_BACKEND == TINT_BACKEND_GMP
+        mpz_import(ret.backend().data(), numLimbs, -1, sizeof(uint64_t), 0, 0, limbs);
+    #elif TINT_BACKEND == TINT_BACKEND_TOMMATH
+        for (size_t i = numLimbs; i > 0; --i)
+        {
+            ret <<= 64;
+            ret |= limbs[i - 1];
+        }
+    #else
+        boost::multiprecision::import_bits(ret, limbs, limbs + numLimbs, 64, false);
+    #endif
+    return ret;
+}
@@ -10,72 +10,513 @@
 
 #include <array>
 #include <vector>
+#include <algorithm>
+#include <stdint.h>
+#include <chrono>
+#include <random>
 
 //=================================================================================
 // Internal Functionality
 //=================================================================================
 
-template <size_t NUM_INPUT_BITS>
-bool LookupEntryPassesMask (size_t entry, size_t mask)
+// Turns a truth table into ANF in place, using the binary Mobius (Reed-Muller) transform.
+// After it, bit b of table[termMask] is 1 if output bit b's ANF has the term termMask.
+// Each entry holds every output bit of one input value, so all output bits are transformed
+// at once, in O(n * 2^n) for n input bits.
+inline void ANFMobiusTransform (std::vector<uint64_t> &table, size_t numInputBits)
 {
-    for (size_t i = 0; i < NUM_INPUT_BITS; ++i)
+    const size_t c_inputValueCount = size_t(1) << numInputBits;
+    for (size_t bitIndex = 0; bitIndex < numInputBits; ++bitIndex)
     {
-        const size_t bitMask = 1 << i;
-        const bool allowOnes = (mask & bitMask) != 0;
-        const bool bitPassesMask = allowOnes || (entry & bitMask) == 0;
-        if (!bitPassesMask)
-            return false;
+        const size_t bitMask = size_t(1) << bitIndex;
+        for (size_t i = 0; i < c_inputValueCount; ++i)
+        {
+            if ((i & bitMask) != 0)
+                table[i] ^= table[i ^ bitMask];
+        }
     }
-    return true;
 }
 
-template <size_t NUM_INPUT_BITS>
-bool ANFHasTerm (const std::array<size_t, 1 << NUM_INPUT_BITS> &lookupTable, size_t outputBitIndex, size_t termMask)
+//=================================================================================
+inline size_t ANFCountBits (size_t mask)
+{
+    size_t count = 0;
+    for (; mask != 0; mask &= mask - 1)
+        ++count;
+    return count;
+}
+
+//=================================================================================
+inline size_t ANFHighestBit (size_t mask)
 {
-    const size_t c_inputValueCount = 1 << NUM_INPUT_BITS;
+    size_t bit = 0;
+    while ((mask >> bit) > 1)
+        ++bit;
+    return bit;
+}
 
-    int onesCount = 0;
-    for (size_t i = 0; i < c_inputValueCount; ++i)
+//=================================================================================
+// the two smaller monomials a monomial of degree 2 or more is made from
+inline void ANFSplitMonomial (size_t mask, bool balanced, size_t &a, size_t &b)
+{
+    if (!balanced)
     {
-        if (LookupEntryPassesMask<NUM_INPUT_BITS>(i, termMask) && ((lookupTable[i] >> outputBitIndex) & 1) != 0)
-            onesCount++;
+        b = size_t(1) << ANFHighestBit(mask);
+        a = mask & ~b;
+        return;
     }
 
-    return (onesCount & 1) != 0;
+    a = 0;
+    b = mask;
+    for (size_t i = 0, count = ANFCountBits(mask) / 2; i < count; ++i)
+    {
+        const size_t lowestBit = b & (~b + 1);
+        a |= lowestBit;
+        b &= ~lowestBit;
+    }
 }
 
-template <size_t NUM_INPUT_BITS>
-void MakeANFTruthTable (const std::array<size_t, 1 << NUM_INPUT_BITS> &lookupTable, std::vector<size_t>& terms, size_t outputBitIndex)
+//=================================================================================
+// The size of an ANF when evaluated with the monomial lattice (see
+// MakeANFMonomialLattice()), if every monomial it needs is kept
+struct SANFCost
 {
-    const size_t c_inputValueCount = 1 << NUM_INPUT_BITS;
+    size_t  m_numTerms;         // an XOR each
+    size_t  m_numMonomials;     // an AND each
 
-    // find each ANF term
-    for (size_t termMask = 0; termMask < c_inputValueCount; ++termMask)
+    size_t GetTotal () const { return m_numTerms + m_numMonomials; }
+};
+
+// The ANF's cost with the don't care outputs left at 0, and after choosing them
+struct SANFDontCareReport
+{
+    SANFCost    m_withoutDontCares;
+    SANFCost    m_withDontCares;
+};
+
+//=================================================================================
+// Keeps the lattice cost of an ANF made by ANFMobiusTransform() up to date as its terms
+// are flipped, by counting how many terms and bigger monomials use each monomial.  A
+// monomial costs an AND while anything uses it.
+class CANFLatticeCost
+{
+public:
+    CANFLatticeCost (const std::vector<uint64_t> &anf, bool balanced)
+        : m_useCounts(anf.size(), 0)
+        , m_balanced(balanced)
+    {
+        m_cost.m_numTerms = 0;
+        m_cost.m_numMonomials = 0;
+        for (size_t termMask = 0; termMask < anf.size(); ++termMask)
+        {
+            for (uint64_t outputBits = anf[termMask]; outputBits != 0; outputBits &= outputBits - 1)
+            {
+                ++m_cost.m_numTerms;
+                Use(termMask);
+            }
+        }
+    }
+
+    // flips whether output bit outputBitIndex has the term termMask
+    void FlipTerm (std::vector<uint64_t> &anf, size_t termMask, size_t outputBitIndex)
+    {
+        const uint64_t outputBit = uint64_t(1) << outputBitIndex;
+        if ((anf[termMask] & outputBit) != 0)
+        {
+            --m_cost.m_numTerms;
+            Unuse(termMask);
+        }
+        else
+        {
+            ++m_cost.m_numTerms;
+            Use(termMask);
+        }
+        anf[termMask] ^= outputBit;
+    }
+
+    const SANFCost& GetCost () const { return m_cost; }
+
+private:
+    void Use (size_t mask)
+    {
+        if (ANFCountBits(mask) < 2 || m_useCounts[mask]++ != 0)
+            return;
+        ++m_cost.m_numMonomials;
+
+        size_t a, b;
+        ANFSplitMonomial(mask, m_balanced, a, b);
+        Use(a);
+        Use(b);
+    }
+
+    void Unuse (size_t mask)
+    {
+        if (ANFCountBits(mask) < 2 || --m_useCounts[mask] != 0)
+            return;
+        --m_cost.m_numMonomials;
+
+        size_t a, b;
+        ANFSplitMonomial(mask, m_balanced, a, b);
+        Unuse(a);
+        Unuse(b);
+    }
+
+private:
+    std::vector<uint32_t>   m_useCounts;
+    bool                    m_balanced;
+    SANFCost                m_cost;
+};
+
+//=================================================================================
+// Changes the ANF made by ANFMobiusTransform() to make it cheaper, by picking the outputs
+// of input values that don't matter.  The cost is what the monomial lattice would evaluate
+// (see CANFLatticeCost), so terms that share monomials with others are cheap.
+//
+// Finding the best choice is too slow, so this searches with moves that each flip some
+// don't care outputs, which flips a fixed set of ANF terms.  There are two kinds of moves
+// for each don't care value: flipping just it, which flips every term that is a superset
+// of it, and flipping every don't care value that is a superset of it.  When the don't
+// cares are every input value with some input bits 0, like b == 0, the second kind each
+// flip a different single term of the function of the other input bits, so those moves
+// don't interfere with each other.
+//
+// Each output bit of a move is flipped if that makes the ANF cheaper, until no move does.
+// Then random moves are made a few at a time, followed by the cheaper moves again, keeping
+// the cheapest ANF found.  This stops after searchMS milliseconds, or once many tries in a
+// row haven't helped.  The random numbers have a fixed seed, so a search that isn't cut
+// short by the time limit always gives the same ANF.
+inline void ANFChooseDontCares (std::vector<uint64_t> &anf, size_t numInputBits, const std::vector<size_t> &dontCares, size_t numOutputBits, bool balanced, double searchMS, SANFDontCareReport *report = nullptr)
+{
+    CANFLatticeCost cost(anf, balanced);
+    if (report)
+        report->m_withoutDontCares = cost.GetCost();
+
+    if (dontCares.empty() || searchMS <= 0.0)
     {
-        if (ANFHasTerm<NUM_INPUT_BITS>(lookupTable, outputBitIndex, termMask))
-            terms.push_back(termMask);
+        if (report)
+            report->m_withDontCares = cost.GetCost();
+        return;
     }
+
+    const std::chrono::steady_clock::time_point c_start = std::chrono::steady_clock::now();
+    auto timeLeft = [c_start, searchMS] () -> bool
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - c_start).count() < searchMS;
+    };
+
+    // the terms each move flips
+    std::vector<std::vector<size_t>> moves;
+    for (size_t dontCare : dontCares)
+    {
+        moves.push_back(std::vector<size_t>());
+        for (size_t termMask = dontCare; termMask < anf.size(); termMask = (termMask + 1) | dontCare)
+            moves.back().push_back(termMask);
+    }
+    std::vector<uint64_t> flippedTable;
+    for (size_t dontCare : dontCares)
+    {
+        if (!timeLeft())
+            break;
+
+        flippedTable.assign(anf.size(), 0);
+        size_t numFlipped = 0;
+        for (size_t value : dontCares)
+        {
+            if ((value & dontCare) == dontCare)
+            {
+                flippedTable[value] = 1;
+                ++numFlipped;
+            }
+        }
+
+        // flipping one value is already a move
+        if (numFlipped < 2)
+            continue;
+
+        ANFMobiusTransform(flippedTable, numInputBits);
+        moves.push_back(std::vector<size_t>());
+        for (size_t termMask = 0; termMask < anf.size(); ++termMask)
+        {
+            if (flippedTable[termMask] != 0)
+                moves.back().push_back(termMask);
+        }
+    }
+
+    // which output bits of each move are flipped now, and in the cheapest ANF found
+    std::vector<uint64_t> flipped(moves.size(), 0);
+    std::vector<uint64_t> bestFlipped;
+    size_t bestCost = 0;
+
+    auto flip = [&] (size_t moveIndex, size_t outputBitIndex)
+    {
+        for (size_t termMask : moves[moveIndex])
+            cost.FlipTerm(anf, termMask, outputBitIndex);
+        flipped[moveIndex] ^= uint64_t(1) << outputBitIndex;
+    };
+
+    // make moves while they make the ANF cheaper
+    auto descend = [&] ()
+    {
+        bool improved = true;
+        while (improved && timeLeft())
+        {
+            improved = false;
+            for (size_t moveIndex = 0; moveIndex < moves.size(); ++moveIndex)
+            {
+                for (size_t outputBitIndex = 0; outputBitIndex < numOutputBits; ++outputBitIndex)
+                {
+                    const size_t costBefore = cost.GetCost().GetTotal();
+                    flip(moveIndex, outputBitIndex);
+                    if (cost.GetCost().GetTotal() < costBefore)
+                        improved = true;
+                    else
+                        flip(moveIndex, outputBitIndex);
+                }
+            }
+        }
+    };
+
+    descend();
+    bestFlipped = flipped;
+    bestCost = cost.GetCost().GetTotal();
+
+    std::mt19937 random(0);
+    const size_t c_maxTriesWithoutImproving = 4 * moves.size() * numOutputBits;
+    const size_t c_maxMovesPerTry = std::min<size_t>(moves.size(), 4);
+    for (size_t triesWithoutImproving = 0; triesWithoutImproving < c_maxTriesWithoutImproving && timeLeft(); ++triesWithoutImproving)
+    {
+        // make a few random moves, whether they help or not
+        const size_t numMoves = 1 + random() % c_maxMovesPerTry;
+        for (size_t i = 0; i < numMoves; ++i)
+        {
+            const size_t moveIndex = random() % moves.size();
+            const size_t outputBitIndex = random() % numOutputBits;
+            flip(moveIndex, outputBitIndex);
+        }
+        descend();
+
+        if (cost.GetCost().GetTotal() < bestCost)
+        {
+            bestFlipped = flipped;
+            bestCost = cost.GetCost().GetTotal();
+            triesWithoutImproving = 0;
+            continue;
+        }
+
+        // go back to the cheapest ANF
+        for (size_t moveIndex = 0; moveIndex < moves.size(); ++moveIndex)
+        {
+            for (size_t outputBitIndex = 0; outputBitIndex < numOutputBits; ++outputBitIndex)
+            {
+                if (((flipped[moveIndex] ^ bestFlipped[moveIndex]) >> outputBitIndex) & 1)
+                    flip(moveIndex, outputBitIndex);
+            }
+        }
+    }
+
+    if (report)
+        report->m_withDontCares = cost.GetCost();
 }
 
 //=================================================================================
 // Entry Point
 //=================================================================================
 
-template <size_t NUM_INPUT_BITS, size_t NUM_OUTPUT_BITS, typename LAMBDA>
-std::array<std::vector<size_t>, NUM_OUTPUT_BITS> MakeANFTerms (const LAMBDA& lambda)
+// Makes the ANF terms of each output bit of lambda(inputValue, NUM_INPUT_BITS).  Input
+// values where dontCare(inputValue, NUM_INPUT_BITS) is true never happen, so their outputs
+// are picked to make the ANF cheaper, spending up to searchMS milliseconds looking (see
+// ANFChooseDontCares()).  balanced is how the monomial lattice will be made, which the
+// cost depends on.  If report isn't null, it gets the cost with and without the choice.
+template <size_t NUM_INPUT_BITS, size_t NUM_OUTPUT_BITS, typename LAMBDA, typename DONTCARE>
+std::array<std::vector<size_t>, NUM_OUTPUT_BITS> MakeANFTerms (const LAMBDA& lambda, const DONTCARE& dontCare, bool balanced, double searchMS, SANFDontCareReport *report = nullptr)
 {
-    // make lookup table
-    const size_t c_outputValueMask = (1 << NUM_OUTPUT_BITS) - 1;
-    const size_t c_inputValueCount = 1 << NUM_INPUT_BITS;
-    std::array<size_t, c_inputValueCount> lookupTable;
+    static_assert(NUM_OUTPUT_BITS <= 64, "the output bits of each lookup table entry are kept in a uint64_t");
+
+    // make lookup table.  It's on the heap, since it can be much too big for the stack.
+    const uint64_t c_outputValueMask = NUM_OUTPUT_BITS == 64 ? ~uint64_t(0) : (uint64_t(1) << NUM_OUTPUT_BITS) - 1;
+    const size_t c_inputValueCount = size_t(1) << NUM_INPUT_BITS;
+    std::vector<uint64_t> table(c_inputValueCount);
+    std::vector<size_t> dontCares;
     for (size_t inputValue = 0; inputValue < c_inputValueCount; ++inputValue)
-        lookupTable[inputValue] = lambda(inputValue, NUM_INPUT_BITS) & c_outputValueMask;
+    {
+        if (dontCare(inputValue, NUM_INPUT_BITS))
+        {
+            table[inputValue] = 0;
+            dontCares.push_back(inputValue);
+        }
+        else
+            table[inputValue] = uint64_t(lambda(inputValue, NUM_INPUT_BITS)) & c_outputValueMask;
+    }
 
     // make the anf for each truth table (each output bit of the lookup table)
+    ANFMobiusTransform(table, NUM_INPUT_BITS);
+    ANFChooseDontCares(table, NUM_INPUT_BITS, dontCares, NUM_OUTPUT_BITS, balanced, searchMS, report);
     std::array<std::vector<size_t>, NUM_OUTPUT_BITS> terms;
-    for (size_t outputBitIndex = 0; outputBitIndex < NUM_OUTPUT_BITS; ++outputBitIndex)
-        MakeANFTruthTable<NUM_INPUT_BITS>(lookupTable, terms[outputBitIndex], outputBitIndex);
+    for (size_t termMask = 0; termMask < c_inputValueCount; ++termMask)
+    {
+        for (uint64_t outputBits = table[termMask]; outputBits != 0; outputBits &= outputBits - 1)
+        {
+            size_t outputBitIndex = 0;
+            while (((outputBits >> outputBitIndex) & 1) == 0)
+                ++outputBitIndex;
+            terms[outputBitIndex].push_back(termMask);
+        }
+    }
 
     // return the terms we calculated
     return terms;
-}
\ No newline at end of file
+}
+
+//=================================================================================
+template <size_t NUM_INPUT_BITS, size_t NUM_OUTPUT_BITS, typename LAMBDA>
+std::array<std::vector<size_t>, NUM_OUTPUT_BITS> MakeANFTerms (const LAMBDA& lambda)
+{
+    return MakeANFTerms<NUM_INPUT_BITS, NUM_OUTPUT_BITS>(lambda, [] (size_t, size_t) { return false; }, false, 0.0);
+}
+
+//=================================================================================
+// Monomial Lattice
+//
+// An ANF term is a monomial: the AND of the input bits set in its mask.  Terms share
+// a lot of their ANDs, across one output bit's terms and across output bits, so
+// instead of ANDing each term's bits together from scratch, each distinct monomial
+// is made once, by ANDing two smaller monomials.  Only monomials that a term needs,
+// directly or as one of those smaller monomials, are made.  At most maxMonomials of
+// them are kept, lowest degree first, so a monomial's smaller monomials are always
+// kept if it is.  Terms that need a monomial that wasn't kept start from the biggest
+// kept monomial that is a prefix of them and AND the rest of their bits in.
+//
+// If balanced is false, a monomial is the monomial without its highest bit ANDed with
+// that bit, which makes the fewest monomials.  If it is true, a monomial is its lower
+// half of bits ANDed with its upper half, so each monomial is made by a balanced tree
+// of ANDs.  Superpositional bits all have about the same size and ANDs multiply, so
+// the two sides of each AND are about the same size.  Big multiplies of equal sized
+// numbers are the ones Karatsuba multiplication speeds up.
+//=================================================================================
+
+struct SANFMonomialLattice
+{
+    // the values a monomial or term starts from are indexed with the input bits first,
+    // followed by the monomials
+    static const size_t c_constantOne = size_t(-1);
+
+    // the two smaller monomials, or input bits, ANDed together to make a monomial
+    struct SMonomial
+    {
+        size_t  m_a;
+        size_t  m_b;
+    };
+
+    struct STerm
+    {
+        size_t  m_value;        // the monomial or input bit to start from, or c_constantOne
+        size_t  m_extraBits;    // mask of input bits to AND with that
+    };
+
+    // sorted by degree, so each monomial comes after the ones it is made from.  Monomials
+    // with the same degree don't depend on each other.  The monomials of degree d start
+    // at m_degreeStarts[d-2].
+    std::vector<SMonomial>              m_monomials;
+    std::vector<size_t>                 m_degreeStarts;
+
+    // the terms of each output bit, in the same order as MakeANFTerms() gave them
+    std::vector<std::vector<STerm>>     m_terms;
+
+    // how many ANDs evaluating the terms takes, without and with the lattice
+    size_t                              m_numANDsWithoutLattice;
+    size_t                              m_numANDs;
+};
+
+//=================================================================================
+// marks a monomial and everything it is made from as needed
+inline void ANFMarkMonomial (size_t mask, bool balanced, std::vector<bool> &needed)
+{
+    if (ANFCountBits(mask) < 2 || needed[mask])
+        return;
+    needed[mask] = true;
+
+    size_t a, b;
+    ANFSplitMonomial(mask, balanced, a, b);
+    ANFMarkMonomial(a, balanced, needed);
+    ANFMarkMonomial(b, balanced, needed);
+}
+
+//=================================================================================
+template <size_t NUM_INPUT_BITS, size_t NUM_OUTPUT_BITS>
+void MakeANFMonomialLattice (const std::array<std::vector<size_t>, NUM_OUTPUT_BITS> &terms, size_t maxMonomials, bool balanced, SANFMonomialLattice &lattice)
+{
+    const size_t c_inputValueCount = size_t(1) << NUM_INPUT_BITS;
+    const size_t c_notKept = size_t(-1);
+
+    // find every monomial of degree 2 or more that the terms need
+    std::vector<bool> needed(c_inputValueCount, false);
+    for (const std::vector<size_t> &bitTerms : terms)
+    {
+        for (size_t term : bitTerms)
+            ANFMarkMonomial(term, balanced, needed);
+    }
+
+    // keep the lowest degree ones, up to the limit
+    std::vector<size_t> monomialMasks;
+    for (size_t mask = 0; mask < c_inputValueCount; ++mask)
+    {
+        if (needed[mask])
+            monomialMasks.push_back(mask);
+    }
+    std::stable_sort(monomialMasks.begin(), monomialMasks.end(),
+        [] (size_t a, size_t b)
+        {
+            return ANFCountBits(a) < ANFCountBits(b);
+        }
+    );
+    if (monomialMasks.size() > maxMonomials)
+        monomialMasks.resize(maxMonomials);
+
+    // the value index of every kept mask, including the single input bits
+    std::vector<size_t> valueIndex(c_inputValueCount, c_notKept);
+    for (size_t bitIndex = 0; bitIndex < NUM_INPUT_BITS; ++bitIndex)
+        valueIndex[size_t(1) << bitIndex] = bitIndex;
+    for (size_t monomialIndex = 0; monomialIndex < monomialMasks.size(); ++monomialIndex)
+        valueIndex[monomialMasks[monomialIndex]] = NUM_INPUT_BITS + monomialIndex;
+
+    lattice.m_monomials.clear();
+    lattice.m_degreeStarts.clear();
+    for (size_t monomialIndex = 0; monomialIndex < monomialMasks.size(); ++monomialIndex)
+    {
+        const size_t mask = monomialMasks[monomialIndex];
+        size_t a, b;
+        ANFSplitMonomial(mask, balanced, a, b);
+        SANFMonomialLattice::SMonomial monomial = { valueIndex[a], valueIndex[b] };
+        lattice.m_monomials.push_back(monomial);
+
+        while (lattice.m_degreeStarts.size() + 2 <= ANFCountBits(mask))
+            lattice.m_degreeStarts.push_back(monomialIndex);
+    }
+
+    // each term starts from its biggest kept prefix
+    lattice.m_terms.clear();
+    lattice.m_terms.resize(NUM_OUTPUT_BITS);
+    lattice.m_numANDsWithoutLattice = 0;
+    lattice.m_numANDs = lattice.m_monomials.size();
+    for (size_t outputBitIndex = 0; outputBitIndex < NUM_OUTPUT_BITS; ++outputBitIndex)
+    {
+        for (size_t term : terms[outputBitIndex])
+        {
+            SANFMonomialLattice::STerm latticeTerm = { SANFMonomialLattice::c_constantOne, 0 };
+            size_t mask = term;
+            while (mask != 0 && valueIndex[mask] == c_notKept)
+            {
+                const size_t bit = size_t(1) << ANFHighestBit(mask);
+                latticeTerm.m_extraBits |= bit;
+                mask &= ~bit;
+            }
+            if (mask != 0)
+                latticeTerm.m_value = valueIndex[mask];
+            lattice.m_terms[outputBitIndex].push_back(latticeTerm);
+
+            if (term != 0)
+                lattice.m_numANDsWithoutLattice += ANFCountBits(term) - 1;
+            lattice.m_numANDs += ANFCountBits(latticeTerm.m_extraBits);
+        }
+    }
+}
@@ -104,8 +104,11 @@ bool CKeySet::Read (const char *fileName)
     for (const TINT& v : m_keys)
         m_keysLCM *= v;
 
-    // we will reduce numbers since we have an LCM
-    m_reduce = true;
+    // we will reduce numbers if we have an LCM.  A file that didn't parse can leave keys
+    // of 0 behind.
+    m_reduce = m_keysLCM > 1;
+    if (m_reduce)
+        m_reducer.SetModulus(m_keysLCM);
 
     return ret;
 }
@@ -217,6 +220,7 @@ void CKeySet::Calculate (int numBits, const TINT& minKey, const std::function<vo
     progressCallback(100);
 
     // we will reduce numbers since we have an LCM
+    m_reducer.SetModulus(m_keysLCM);
     m_reduce = true;
 }
 
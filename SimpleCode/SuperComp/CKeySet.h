@@ -9,28 +9,95 @@
 #pragma once
 
 #include "TINT.h"
+#include "CBarrettReducer.h"
+#include <algorithm>
 #include <functional>
+#include <atomic>
+
+//=================================================================================
+// When CKeySet::ReduceValue() actually reduces values mod the keys LCM.  Reducing keeps
+// values small, which speeds up the gates that follow, but costs time itself, so which
+// policy is fastest depends on the circuit.
+//=================================================================================
+enum class EReducePolicy
+{
+    Never,          // never reduce
+    Always,         // reduce after every gate
+    Threshold,      // reduce values with at least min(parameter, 2) times as many bits as the LCM
+    EveryNGates,    // reduce on every parameter'th gate
+};
+
+class CCircuit;
 
 class CKeySet
 {
 public:
-    CKeySet() : m_reduce(false) {}
+    CKeySet() : m_reduce(false), m_reducePolicy(EReducePolicy::Always), m_reduceParameter(1), m_reduceGateCount(0), m_recorder(nullptr) {}
 
     bool Read (const char *fileName);
     bool Write (const char *fileName) const;
 
-    void CalculateCached (int numBits, const TINT& minKey, const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t percent) {} );
-    void Calculate (int numBits, const TINT& minKey, const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t percent) {} );
+    void CalculateCached (int numBits, const TINT& minKey, const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t) {} );
+    void Calculate (int numBits, const TINT& minKey, const std::function<void (uint8_t percent)>& progressCallback = [] (uint8_t) {} );
 
     const std::vector<TINT> &GetSuperPositionedBits () const { return m_superPositionedBits; }
     const std::vector<TINT> &GetKeys () const { return m_keys; }
 
-    void ReduceValue (TINT& v) const { /*if (m_reduce) { ReduceValueExplicit(v); }*/ }
+    // reduces v mod the keys LCM, using a precomputed reciprocal instead of a division.
+    // Whether it does anything depends on the reduce policy.
+    void ReduceValue (TINT& v) const
+    {
+        if (!m_reduce)
+            return;
+
+        switch (m_reducePolicy)
+        {
+            case EReducePolicy::Never:
+                return;
+            case EReducePolicy::Always:
+                break;
+            case EReducePolicy::Threshold:
+            {
+                // Barrett reduction only works below 2^(2k) for a k bit LCM, so the threshold
+                // stops at 2k bits.  Sums crossing it are still in range, but products of
+                // values under it can be up to twice as long and take the division.
+                // msb() only looks at the top limb.
+                const size_t thresholdBits = std::min<size_t>(m_reduceParameter, 2) * m_reducer.GetModulusBits();
+                if (v.sign() <= 0 || boost::multiprecision::msb(v) + 1 < thresholdBits)
+                    return;
+                break;
+            }
+            case EReducePolicy::EveryNGates:
+                if (++m_reduceGateCount % m_reduceParameter != 0)
+                    return;
+                break;
+        }
+        m_reducer.Reduce(v);
+    }
 
-    void ReduceValueExplicit (TINT& v) const { v = v % m_keysLCM; }
+    // Sets when ReduceValue() reduces, and the threshold multiplier (1 or 2, larger values
+    // act like 2) or gate count for the policies that use one.  The default is
+    // EReducePolicy::Always.
+    void SetReducePolicy (EReducePolicy policy, size_t parameter = 1)
+    {
+        m_reducePolicy = policy;
+        m_reduceParameter = parameter > 0 ? parameter : 1;
+        m_reduceGateCount = 0;
+    }
+    EReducePolicy GetReducePolicy () const { return m_reducePolicy; }
+    size_t GetReduceParameter () const { return m_reduceParameter; }
+
+    void ReduceValueExplicit (TINT& v) const { m_reducer.Reduce(v); }
+
+    size_t GetKeysLCMBits () const { return m_reducer.GetModulusBits(); }
 
     float GetComplexityIndex () const;
 
+    // While a recorder is set, the TINT HE operations add gates to it instead of doing
+    // math, and TINT bits hold node indices.  See CCircuit.  nullptr stops recording.
+    void SetRecorder (CCircuit *recorder) { m_recorder = recorder; }
+    CCircuit* GetRecorder () const { return m_recorder; }
+
 private:
     void MakeKey (size_t keyIndex);
     bool KeyIsCoprime (size_t keyIndex, TINT& value) const;
@@ -41,4 +108,11 @@ private:
     std::vector<TINT>   m_keys;
     TINT                m_keysLCM;
     bool                m_reduce;
+    CBarrettReducer     m_reducer;
+
+    EReducePolicy               m_reducePolicy;
+    size_t                      m_reduceParameter;
+    mutable std::atomic<size_t> m_reduceGateCount;
+
+    CCircuit*                   m_recorder;
 };
\ No newline at end of file
@@ -0,0 +1,225 @@
+//=================================================================================
+//
+//  CLUTCircuit
+//
+//  ANF circuit evaluation.  CLUTCircuit itself is a template, in the header.
+//
+//=================================================================================
+
+#include "CLUTCircuit.h"
+
+//=================================================================================
+static const TINT& ANFValue (size_t valueIndex, const TINT* inputBits, size_t numInputBits, const std::vector<TINT>& monomials)
+{
+    return valueIndex < numInputBits ? inputBits[valueIndex] : monomials[valueIndex - numInputBits];
+}
+
+//=================================================================================
+// An operand of a term's ANDs, and how many bits it has.  msb() only looks at the top limb.
+typedef std::pair<size_t, const TINT*> TANFOperand;
+
+static TANFOperand ANFOperand (const TINT& value)
+{
+    return TANFOperand(value.sign() > 0 ? size_t(boost::multiprecision::msb(value)) + 1 : 0, &value);
+}
+
+//=================================================================================
+void EvaluateANFMonomials (
+    const SANFMonomialLattice& lattice,
+    const TINT* inputBits,
+    size_t numInputBits,
+    const CKeySet& keySet,
+    std::vector<TINT>& monomials,
+    size_t numThreads
+) {
+    monomials.resize(lattice.m_monomials.size());
+    for (size_t degreeIndex = 0; degreeIndex < lattice.m_degreeStarts.size(); ++degreeIndex)
+    {
+        const size_t begin = lattice.m_degreeStarts[degreeIndex];
+        const size_t end = degreeIndex + 1 < lattice.m_degreeStarts.size() ? lattice.m_degreeStarts[degreeIndex + 1] : monomials.size();
+        ParallelFor(numThreads, end - begin,
+            [&] (size_t index)
+            {
+                const SANFMonomialLattice::SMonomial& monomial = lattice.m_monomials[begin + index];
+                monomials[begin + index] = AND(ANFValue(monomial.m_a, inputBits, numInputBits, monomials), ANFValue(monomial.m_b, inputBits, numInputBits, monomials), keySet);
+            }
+        );
+    }
+}
+
+//=================================================================================
+TINT EvaluateANFTerms (
+    const std::vector<SANFMonomialLattice::STerm>& terms,
+    size_t beginTerm,
+    size_t endTerm,
+    const TINT* inputBits,
+    size_t numInputBits,
+    const std::vector<TINT>& monomials,
+    const CKeySet& keySet
+) {
+    TINT xorSum = 0;
+    std::vector<TANFOperand> operands;
+    std::vector<TINT> products;
+    for (size_t termIndex = beginTerm; termIndex < endTerm; ++termIndex)
+    {
+        const SANFMonomialLattice::STerm& term = terms[termIndex];
+        if (term.m_value == SANFMonomialLattice::c_constantOne && term.m_extraBits == 0)
+        {
+            XOREQ(xorSum, 1, keySet);
+        }
+        else if (term.m_extraBits == 0)
+        {
+            XOREQ(xorSum, ANFValue(term.m_value, inputBits, numInputBits, monomials), keySet);
+        }
+        else
+        {
+            // AND the two smallest values together until there is one left, so that big
+            // multiplies are between values of about the same size.  The operands are
+            // referenced where they are, and ordered by how many bits they have.
+            operands.clear();
+            products.clear();
+            if (term.m_value != SANFMonomialLattice::c_constantOne)
+                operands.push_back(ANFOperand(ANFValue(term.m_value, inputBits, numInputBits, monomials)));
+
+            for (size_t bitIndex = 0; bitIndex < numInputBits; ++bitIndex)
+            {
+                const size_t bitMask = 1 << bitIndex;
+                if ((term.m_extraBits & bitMask) != 0)
+                    operands.push_back(ANFOperand(inputBits[bitIndex]));
+            }
+
+            // products never reallocate, so pointers to them stay valid
+            products.reserve(operands.size());
+            std::make_heap(operands.begin(), operands.end(), std::greater<TANFOperand>());
+            while (operands.size() > 1)
+            {
+                std::pop_heap(operands.begin(), operands.end(), std::greater<TANFOperand>());
+                const TINT* a = operands.back().second;
+                operands.pop_back();
+                std::pop_heap(operands.begin(), operands.end(), std::greater<TANFOperand>());
+                const TINT* b = operands.back().second;
+                operands.pop_back();
+
+                products.push_back(AND(*a, *b, keySet));
+                operands.push_back(ANFOperand(products.back()));
+                std::push_heap(operands.begin(), operands.end(), std::greater<TANFOperand>());
+            }
+            XOREQ(xorSum, *operands[0].second, keySet);
+        }
+    }
+    return xorSum;
+}
+
+//=================================================================================
+// Evaluates the ANF terms of every output bit across threads.
+//
+// XOR is addition, so adding up chunks of a term list and then adding the chunk sums
+// gives the same integer as adding the terms one at a time when nothing is reduced.
+// When everything is reduced, both give the sum mod the keys LCM.  Either way the
+// outputs are identical to EvaluateANFTerms() over the whole list.
+static void EvaluateANFParallel (
+    const SANFMonomialLattice& lattice,
+    const TINT* inputBits,
+    size_t numInputBits,
+    const CKeySet& keySet,
+    TINT* outputBits,
+    size_t numThreads,
+    size_t termsPerChunk
+) {
+    std::vector<TINT> monomials;
+    EvaluateANFMonomials(lattice, inputBits, numInputBits, keySet, monomials, numThreads);
+
+    const std::vector<std::vector<SANFMonomialLattice::STerm>>& terms = lattice.m_terms;
+    const size_t numOutputBits = terms.size();
+
+    struct SChunk
+    {
+        size_t  m_outputBitIndex;
+        size_t  m_beginTerm;
+        size_t  m_endTerm;
+    };
+
+    // an output bit's chunks are next to each other, starting at firstChunk[outputBitIndex]
+    std::vector<SChunk> chunks;
+    std::vector<size_t> firstChunk(numOutputBits + 1);
+    for (size_t outputBitIndex = 0; outputBitIndex < numOutputBits; ++outputBitIndex)
+    {
+        firstChunk[outputBitIndex] = chunks.size();
+        const size_t numTerms = terms[outputBitIndex].size();
+        for (size_t beginTerm = 0; beginTerm < numTerms; beginTerm += termsPerChunk)
+        {
+            SChunk chunk = { outputBitIndex, beginTerm, std::min<size_t>(beginTerm + termsPerChunk, numTerms) };
+            chunks.push_back(chunk);
+        }
+    }
+    firstChunk[numOutputBits] = chunks.size();
+
+    std::vector<TINT> sums(chunks.size());
+    ParallelFor(numThreads, chunks.size(),
+        [&] (size_t chunkIndex)
+        {
+            const SChunk& chunk = chunks[chunkIndex];
+            sums[chunkIndex] = EvaluateANFTerms(terms[chunk.m_outputBitIndex], chunk.m_beginTerm, chunk.m_endTerm, inputBits, numInputBits, monomials, keySet);
+        }
+    );
+
+    // XOR each output bit's chunk sums together as a tree.  Each level XORs the sums that
+    // are a multiple of 2*stride past the output bit's first chunk with the sum stride
+    // after them, for every output bit at once.
+    std::vector<size_t> pairs;
+    for (size_t stride = 1; stride < chunks.size(); stride *= 2)
+    {
+        pairs.clear();
+        for (size_t outputBitIndex = 0; outputBitIndex < numOutputBits; ++outputBitIndex)
+        {
+            for (size_t i = firstChunk[outputBitIndex]; i + stride < firstChunk[outputBitIndex + 1]; i += stride * 2)
+                pairs.push_back(i);
+        }
+        if (pairs.empty())
+            break;
+
+        ParallelFor(numThreads, pairs.size(),
+            [&] (size_t pairIndex)
+            {
+                const size_t i = pairs[pairIndex];
+                XOREQ(sums[i], sums[i + stride], keySet);
+            }
+        );
+    }
+
+    for (size_t outputBitIndex = 0; outputBitIndex < numOutputBits; ++outputBitIndex)
+    {
+        if (firstChunk[outputBitIndex] < firstChunk[outputBitIndex + 1])
+            outputBits[outputBitIndex] = sums[firstChunk[outputBitIndex]];
+        else
+            outputBits[outputBitIndex] = 0;
+    }
+}
+
+//=================================================================================
+void EvaluateANF (
+    const SANFMonomialLattice& lattice,
+    const TINT* inputBits,
+    size_t numInputBits,
+    const CKeySet& keySet,
+    TINT* outputBits,
+    size_t numThreads,
+    size_t termsPerChunk
+) {
+    // splitting the work up only gives the same values as doing it in order when values are
+    // reduced never or always, and recording has to happen in order
+    const EReducePolicy reducePolicy = keySet.GetReducePolicy();
+    if (numThreads != 1 && keySet.GetRecorder() == nullptr && (reducePolicy == EReducePolicy::Never || reducePolicy == EReducePolicy::Always))
+    {
+        EvaluateANFParallel(lattice, inputBits, numInputBits, keySet, outputBits, numThreads, termsPerChunk);
+        return;
+    }
+
+    std::vector<TINT> monomials;
+    EvaluateANFMonomials(lattice, inputBits, numInputBits, keySet, monomials, 1);
+    for (size_t outputBitIndex = 0; outputBitIndex < lattice.m_terms.size(); ++outputBitIndex)
+    {
+        const std::vector<SANFMonomialLattice::STerm>& bitTerms = lattice.m_terms[outputBitIndex];
+        outputBits[outputBitIndex] = EvaluateANFTerms(bitTerms, 0, bitTerms.size(), inputBits, numInputBits, monomials, keySet);
+    }
+}
@@ -0,0 +1,325 @@
+//=================================================================================
+//
+//  CLUTCircuit
+//
+//  Turns a function of NUM_INPUTS words of INPUT_BITS bits each, given as a lookup
+//  function, into a superpositional circuit with OUTPUT_BITS output bits.
+//
+//  It always makes an ANF circuit from the lookup table (see ANF.h).  If a gate
+//  function is also given, doing the same thing with CSuperInt math, that circuit is
+//  recorded (see CCircuit.h) to count its gates.  The cost of each circuit is
+//  predicted from the smallest key it needs and how big its values get:
+//
+//  * Gate circuits reduce after every gate, so every value is about the size of the
+//    keys LCM, and each AND is a multiply plus a Barrett reduction.
+//  * ANF circuits never reduce, so a monomial of degree d is d times the size of the
+//    LCM, and ANDing and XORing them costs more as they grow.
+//
+//  Evaluate() runs the circuit predicted to be cheaper, which is the one GetMinKey()
+//  and GetReducePolicy() are for.  Inputs where the optional don't care function is
+//  true never happen, so the ANF may give anything for them.
+//
+//=================================================================================
+
+#pragma once
+
+#include <vector>
+#include <array>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include "CSuperInt.h"
+#include "ANF.h"
+#include "CCircuit.h"
+#include "ParallelFor.h"
+
+//=================================================================================
+// ANF circuit evaluation (see CLUTCircuit.cpp)
+//=================================================================================
+
+// Makes the monomials of the lattice (see ANF.h), one degree at a time.  Monomials of the
+// same degree are split across numThreads threads, or all hardware threads if it's 0.
+void EvaluateANFMonomials (
+    const SANFMonomialLattice& lattice,
+    const TINT* inputBits,
+    size_t numInputBits,
+    const CKeySet& keySet,
+    std::vector<TINT>& monomials,
+    size_t numThreads
+);
+
+// XORs together the ANF terms [beginTerm, endTerm) of one output bit, using the monomials
+// made by EvaluateANFMonomials().
+TINT EvaluateANFTerms (
+    const std::vector<SANFMonomialLattice::STerm>& terms,
+    size_t beginTerm,
+    size_t endTerm,
+    const TINT* inputBits,
+    size_t numInputBits,
+    const std::vector<TINT>& monomials,
+    const CKeySet& keySet
+);
+
+// Evaluates the ANF terms of every output bit with numThreads threads, or all hardware
+// threads if it's 0.  Each output bit's terms are split into chunks of termsPerChunk terms,
+// threads take chunks as they finish the last one, and the chunks of each output bit are
+// XORed back together pairwise.  The results are the same values one thread makes.  Only
+// the Never and Always reduce policies guarantee that, so other policies, and recording a
+// circuit, use one thread.
+void EvaluateANF (
+    const SANFMonomialLattice& lattice,
+    const TINT* inputBits,
+    size_t numInputBits,
+    const CKeySet& keySet,
+    TINT* outputBits,
+    size_t numThreads,
+    size_t termsPerChunk
+);
+
+//=================================================================================
+// CLUTCircuit
+//=================================================================================
+
+enum class ELUTCircuit
+{
+    ANF,
+    Gates,
+
+    Count
+};
+
+template <size_t NUM_INPUTS, size_t INPUT_BITS, size_t OUTPUT_BITS = INPUT_BITS>
+class CLUTCircuit
+{
+public:
+    static const size_t c_numInputBits = NUM_INPUTS * INPUT_BITS;
+
+    typedef CSuperInt<INPUT_BITS> TInput;
+    typedef CSuperInt<OUTPUT_BITS> TOutput;
+    typedef std::array<size_t, NUM_INPUTS> TValues;
+
+    typedef std::function<size_t (const TValues& inputs)> TLookupFunction;
+    typedef std::function<bool (const TValues& inputs)> TDontCareFunction;
+    typedef std::function<TOutput (const std::vector<TInput>& inputs)> TGateFunction;
+
+    // what a circuit is predicted to cost
+    struct SCost
+    {
+        bool    m_exists;
+        TINT    m_minKey;           // the smallest key the circuit works with
+        size_t  m_keysLCMBits;      // about how many bits the LCM of keys that big has
+        size_t  m_numXORs;
+        size_t  m_numANDs;
+        double  m_cost;             // predicted 64 bit limb operations
+    };
+
+    // Makes the circuits and chooses one.  dontCareSearchMS is how long to spend choosing
+    // the ANF's outputs for don't care inputs (see ANFChooseDontCares() in ANF.h).
+    // maxANFMonomials and balancedANFMonomials are how the ANF's monomials are shared (see
+    // MakeANFMonomialLattice() in ANF.h).
+    CLUTCircuit (
+        const TLookupFunction& lookup,
+        const TGateFunction& gates = TGateFunction(),
+        const TDontCareFunction& dontCare = TDontCareFunction(),
+        double dontCareSearchMS = 0.0,
+        size_t maxANFMonomials = 65536,
+        bool balancedANFMonomials = false
+    )
+        : m_lookup(lookup)
+        , m_gates(gates)
+        , m_dontCare(dontCare)
+        , m_numANFThreads(1)
+        , m_anfTermsPerChunk(32)
+    {
+        static_assert(c_numInputBits < sizeof(size_t) * 8, "the inputs need to fit in a size_t");
+
+        auto lambda = [this] (size_t inputValue, size_t) -> size_t {
+            return m_lookup(ValuesFromIndex(inputValue));
+        };
+        auto dontCareLambda = [this] (size_t inputValue, size_t) -> bool {
+            return IsDontCare(ValuesFromIndex(inputValue));
+        };
+        m_anfTerms = MakeANFTerms<c_numInputBits, OUTPUT_BITS>(lambda, dontCareLambda, balancedANFMonomials, dontCareSearchMS);
+        MakeANFMonomialLattice<c_numInputBits, OUTPUT_BITS>(m_anfTerms, maxANFMonomials, balancedANFMonomials, m_anfLattice);
+
+        PredictANFCost();
+        PredictGatesCost();
+        m_circuit = (m_costs[size_t(ELUTCircuit::Gates)].m_exists && m_costs[size_t(ELUTCircuit::Gates)].m_cost < m_costs[size_t(ELUTCircuit::ANF)].m_cost)
+            ? ELUTCircuit::Gates
+            : ELUTCircuit::ANF;
+    }
+
+    // threads for ANF evaluation (see EvaluateANF()).  The default is 1.
+    void SetANFThreads (size_t numThreads, size_t termsPerChunk)
+    {
+        m_numANFThreads = numThreads;
+        m_anfTermsPerChunk = termsPerChunk;
+    }
+
+    // the circuit Evaluate() runs, and the smallest key and reduce policy it needs
+    ELUTCircuit GetCircuit () const { return m_circuit; }
+    const TINT& GetMinKey () const { return GetCost(m_circuit).m_minKey; }
+    EReducePolicy GetReducePolicy () const { return GetReducePolicy(m_circuit); }
+
+    static EReducePolicy GetReducePolicy (ELUTCircuit circuit)
+    {
+        return circuit == ELUTCircuit::ANF ? EReducePolicy::Never : EReducePolicy::Always;
+    }
+
+    const SCost& GetCost (ELUTCircuit circuit) const { return m_costs[size_t(circuit)]; }
+
+    // the input words are bits [i*INPUT_BITS, (i+1)*INPUT_BITS) of the index
+    static TValues ValuesFromIndex (size_t inputValue)
+    {
+        TValues values;
+        const size_t c_mask = (size_t(1) << INPUT_BITS) - 1;
+        for (size_t i = 0; i < NUM_INPUTS; ++i)
+            values[i] = (inputValue >> (i * INPUT_BITS)) & c_mask;
+        return values;
+    }
+
+    size_t Lookup (const TValues& inputs) const
+    {
+        return m_lookup(inputs) & ((size_t(1) << OUTPUT_BITS) - 1);
+    }
+
+    bool IsDontCare (const TValues& inputs) const
+    {
+        return m_dontCare && m_dontCare(inputs);
+    }
+
+    TOutput Evaluate (const std::vector<TInput>& inputs) const
+    {
+        return Evaluate(m_circuit, inputs);
+    }
+
+    TOutput Evaluate (ELUTCircuit circuit, const std::vector<TInput>& inputs) const
+    {
+        Assert_(inputs.size() == NUM_INPUTS);
+        if (circuit == ELUTCircuit::Gates)
+            return m_gates(inputs);
+
+        std::array<TINT, c_numInputBits> inputBits;
+        for (size_t i = 0; i < NUM_INPUTS; ++i)
+            std::copy(inputs[i].GetBits().begin(), inputs[i].GetBits().end(), inputBits.begin() + i * INPUT_BITS);
+
+        TOutput ret(inputs[0].GetKeySet());
+        EvaluateANF(m_anfLattice, inputBits.data(), c_numInputBits, *inputs[0].GetKeySet(), ret.GetBits().data(), m_numANFThreads, m_anfTermsPerChunk);
+        return ret;
+    }
+
+private:
+    // limb operations to add or multiply numbers of these sizes, using schoolbook multiplication
+    static double AddCost (double bits) { return bits / 64.0; }
+    static double MultiplyCost (double bitsA, double bitsB) { return (bitsA / 64.0) * (bitsB / 64.0); }
+
+    //=================================================================================
+    // Runs a circuit on plaintext 1 bits with no keys to see how big its outputs can get,
+    // which is the smallest key it works with, like DoTest() does.
+    TINT FindMinKey (ELUTCircuit circuit) const
+    {
+        std::shared_ptr<CKeySet> exploreKeys = std::make_shared<CKeySet>();
+        std::vector<TInput> inputs(NUM_INPUTS, TInput(exploreKeys));
+        for (TInput &input : inputs)
+            input.SetToBinaryMax();
+        TOutput result = Evaluate(circuit, inputs);
+        return *std::max_element(result.GetBits().begin(), result.GetBits().end());
+    }
+
+    //=================================================================================
+    // each key is about as big as the smallest one, and there is one for each input value
+    static size_t KeysLCMBits (const TINT& minKey)
+    {
+        const size_t c_keyBits = minKey > 0 ? size_t(boost::multiprecision::msb(minKey)) + 1 : 1;
+        return c_keyBits << c_numInputBits;
+    }
+
+    //=================================================================================
+    void PredictANFCost ()
+    {
+        SCost &cost = m_costs[size_t(ELUTCircuit::ANF)];
+        cost.m_exists = true;
+        cost.m_minKey = FindMinKey(ELUTCircuit::ANF);
+        cost.m_keysLCMBits = KeysLCMBits(cost.m_minKey);
+        cost.m_numANDs = m_anfLattice.m_numANDs;
+        cost.m_numXORs = 0;
+
+        // Nothing is reduced, so a monomial of degree d is d times the size of the LCM.  Each
+        // is made by multiplying a monomial one degree lower by an input bit.
+        const double c_lcmBits = double(cost.m_keysLCMBits);
+        cost.m_cost = 0.0;
+        for (size_t degreeIndex = 0; degreeIndex < m_anfLattice.m_degreeStarts.size(); ++degreeIndex)
+        {
+            const size_t begin = m_anfLattice.m_degreeStarts[degreeIndex];
+            const size_t end = degreeIndex + 1 < m_anfLattice.m_degreeStarts.size() ? m_anfLattice.m_degreeStarts[degreeIndex + 1] : m_anfLattice.m_monomials.size();
+            cost.m_cost += double(end - begin) * MultiplyCost(double(degreeIndex + 1) * c_lcmBits, c_lcmBits);
+        }
+
+        // each term is XORed into its output bit, and terms whose monomial wasn't kept AND in
+        // the rest of their bits
+        for (size_t outputBitIndex = 0; outputBitIndex < OUTPUT_BITS; ++outputBitIndex)
+        {
+            for (size_t termIndex = 0; termIndex < m_anfTerms[outputBitIndex].size(); ++termIndex)
+            {
+                const size_t degree = ANFCountBits(m_anfTerms[outputBitIndex][termIndex]);
+                const size_t extraBits = ANFCountBits(m_anfLattice.m_terms[outputBitIndex][termIndex].m_extraBits);
+                cost.m_cost += AddCost(double(std::max<size_t>(degree, 1)) * c_lcmBits);
+                cost.m_cost += double(extraBits) * MultiplyCost(double(degree) * c_lcmBits, c_lcmBits);
+                ++cost.m_numXORs;
+            }
+        }
+    }
+
+    //=================================================================================
+    void PredictGatesCost ()
+    {
+        SCost &cost = m_costs[size_t(ELUTCircuit::Gates)];
+        cost.m_exists = bool(m_gates);
+        cost.m_minKey = 0;
+        cost.m_keysLCMBits = 0;
+        cost.m_numXORs = 0;
+        cost.m_numANDs = 0;
+        cost.m_cost = 0.0;
+        if (!cost.m_exists)
+            return;
+
+        cost.m_minKey = FindMinKey(ELUTCircuit::Gates);
+        cost.m_keysLCMBits = KeysLCMBits(cost.m_minKey);
+
+        // count the gates by recording them
+        CCircuit circuit;
+        std::shared_ptr<CKeySet> recordKeys = std::make_shared<CKeySet>();
+        recordKeys->SetRecorder(&circuit);
+        std::vector<TINT> inputNodes(INPUT_BITS);
+        std::vector<TInput> inputs;
+        for (size_t i = 0; i < NUM_INPUTS; ++i)
+        {
+            for (TINT &node : inputNodes)
+                node = circuit.AddInput();
+            std::vector<TINT>::const_iterator inputBits = inputNodes.begin();
+            inputs.push_back(TInput(inputBits, recordKeys));
+        }
+        m_gates(inputs);
+        cost.m_numXORs = circuit.GetNumGates(ECircuitNode::XOR);
+        cost.m_numANDs = circuit.GetNumGates(ECircuitNode::AND);
+
+        // every gate is reduced, so values stay about the size of the LCM.  A Barrett
+        // reduction is two more multiplies, and reducing a sum is a subtraction.
+        const double c_lcmBits = double(cost.m_keysLCMBits);
+        cost.m_cost = double(cost.m_numANDs) * 3.0 * MultiplyCost(c_lcmBits, c_lcmBits) + double(cost.m_numXORs) * 2.0 * AddCost(c_lcmBits);
+    }
+
+private:
+    TLookupFunction                                     m_lookup;
+    TGateFunction                                       m_gates;
+    TDontCareFunction                                   m_dontCare;
+
+    std::array<std::vector<size_t>, OUTPUT_BITS>        m_anfTerms;
+    SANFMonomialLattice                                 m_anfLattice;
+
+    std::array<SCost, size_t(ELUTCircuit::Count)>       m_costs;
+    ELUTCircuit                                         m_circuit;
+
+    size_t                                              m_numANFThreads;
+    size_t                                              m_anfTermsPerChunk;
+};
@@ -14,6 +14,7 @@
 #include <memory>
 #include "CKeySet.h"
 #include "TINT.h"
+#include "CCircuit.h"
 
 #define NOMINMAX
 #include <Windows.h> // for IsDebuggerPresent() and DebugBreak()
@@ -231,14 +232,23 @@ const TINT CSuperInt<NUMBITS>::s_zeroBit = 0;
 //=================================================================================
 inline TINT XOR (const TINT &A, const TINT &B, const CKeySet &keySet)
 {
+    if (CCircuit *circuit = keySet.GetRecorder())
+        return circuit->AddGate(ECircuitNode::XOR, A, B);
+
     TINT result = A + B;
-    keySet.ReduceValue(TINT(result));
+    keySet.ReduceValue(result);
     return result;
 }
 
 //=================================================================================
 inline void XOREQ (TINT &A, const TINT &B, const CKeySet &keySet)
 {
+    if (CCircuit *circuit = keySet.GetRecorder())
+    {
+        A = circuit->AddGate(ECircuitNode::XOR, A, B);
+        return;
+    }
+
     A += B;
     keySet.ReduceValue(A);
 }
@@ -246,6 +256,9 @@ inline void XOREQ (TINT &A, const TINT &B, const CKeySet &keySet)
 //=================================================================================
 inline TINT AND (const TINT &A, const TINT &B, const CKeySet &keySet)
 {
+    if (CCircuit *circuit = keySet.GetRecorder())
+        return circuit->AddGate(ECircuitNode::AND, A, B);
+
     TINT result = A * B;
     keySet.ReduceValue(result);
     return result;
@@ -254,6 +267,12 @@ inline TINT AND (const TINT &A, const TINT &B, const CKeySet &keySet)
 //=================================================================================
 inline void ANDEQ (TINT &A, const TINT &B, const CKeySet &keySet)
 {
+    if (CCircuit *circuit = keySet.GetRecorder())
+    {
+        A = circuit->AddGate(ECircuitNode::AND, A, B);
+        return;
+    }
+
     A *= B;
     keySet.ReduceValue(A);
 }
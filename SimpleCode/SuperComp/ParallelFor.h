@@ -0,0 +1,41 @@
+//=================================================================================
+//
+//  ParallelFor
+//
+//  Spreads a loop across threads
+//
+//=================================================================================
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+//=================================================================================
+// Calls work(index) for every index in [0, count), spread across numThreads threads, or
+// all hardware threads if numThreads is 0.  Threads take the next index as they finish.
+template <typename LAMBDA>
+void ParallelFor (size_t numThreads, size_t count, const LAMBDA& work)
+{
+    std::atomic<size_t> nextIndex(0);
+    auto worker = [&nextIndex, &work, count] ()
+    {
+        for (size_t index = nextIndex++; index < count; index = nextIndex++)
+            work(index);
+    };
+
+    if (numThreads == 0)
+        numThreads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    numThreads = std::min<size_t>(numThreads, count);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < numThreads; ++i)
+        threads.push_back(std::thread(worker));
+
+    // the calling thread works too
+    worker();
+
+    for (std::thread &thread : threads)
+        thread.join();
+}
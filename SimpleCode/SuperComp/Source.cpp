@@ -2,6 +2,10 @@
 #include "CSuperInt.h"
 #include "Shared.h"
 #include "ANF.h"
+#include "CCircuit.h"
+#include "CLUTCircuit.h"
+#include <map>
+#include <string>
 
 // change this to change the size of the superpositional integer
 typedef CSuperInt<3> TSuperInt;
@@ -14,6 +18,51 @@ typedef CSuperInt<3> TSuperInt;
 #define DO_PERF_REPORT()    0
 #define PERF_DATA_SAMPLES() 30
 
+// turn this on to time each operation under each reduce policy and report the fastest
+#define DO_REDUCE_POLICY_REPORT()   0
+#define REDUCE_POLICY_SAMPLES()     10
+
+// turn this on to time each operation with the TINT backend this was built with (see tint.h).
+// Times are kept in Perf_Backends.csv, so building and running with each backend and each
+// size of TSuperInt fills in a table comparing them, which is shown at the end of each run.
+#define DO_BACKEND_REPORT()         0
+#define BACKEND_REPORT_SAMPLES()    10
+#define BACKEND_REPORT_FILE()       "Perf_Backends.csv"
+
+// turn this on to record each operation as a circuit (see CCircuit.h), write it to
+// Circuit_<operation>_<bits>.txt and as flat C++ to Circuit_<operation>_<bits>.cpp, and
+// check that replaying the text file against the real keys gives the same result as
+// the operation did.  The circuits are also optimized (see CCircuit::Optimize()), and a
+// table of how many gates and how much time that saved is shown at the end of each run.
+#define RECORD_CIRCUITS()           0
+#define CIRCUIT_REPORT_SAMPLES()    10
+
+// turn this on to evaluate the ANF circuits with multiple threads (see EvaluateANF() in
+// CLUTCircuit.h).  ANF_THREADS() is how many threads to use, or 0 for all hardware threads,
+// and each thread takes ANF_TERMS_PER_CHUNK() terms of an output bit at a time.  It's off by
+// default so that the ANF timings ReportPerfData() records are single threaded, like the gate
+// based circuit timings they're compared against.
+#define MULTITHREAD_ANF()       0
+#define ANF_THREADS()           0
+#define ANF_TERMS_PER_CHUNK()   32
+
+// the most ANF monomials (ANDs of input bits) to make once and share between every term
+// that uses them (see MakeANFMonomialLattice() in ANF.h).  At 0, each term ANDs all of its
+// input bits together on its own.  Turn on ANF_BALANCED_MONOMIALS() to make each monomial
+// from its lower and upper halves instead of from the monomial without its highest bit.  That
+// evens out the sizes of what is multiplied, but then both sides of most ANDs are big, which
+// was slower for 5 and 6 bit ANF division and modulus.
+#define ANF_MAX_MONOMIALS()         65536
+#define ANF_BALANCED_MONOMIALS()    0
+
+// turn this on to let the ANF give anything for inputs that aren't tested (b == 0 for division
+// and modulus), choosing whatever makes the ANF cheapest within ANF_DONT_CARE_SEARCH_MS() ms
+// (see ANFChooseDontCares() in ANF.h).  It's off by default, since it hasn't been measured to
+// make the circuits faster, and a search cut short by the time limit can give a different ANF
+// from run to run.
+#define ANF_DONT_CARES()            0
+#define ANF_DONT_CARE_SEARCH_MS()   250
+
 typedef std::function<TSuperInt(const TSuperInt&A, const TSuperInt&B)> TestFunc_TSuperInt;
 typedef std::function<int(const int&A, const int&B)> TestFunc_Int;
 typedef std::function<size_t(const size_t &a, const size_t &b)> TestFunc_Size_T;
@@ -74,6 +123,329 @@ void ReportPerfData (const char* opName, bool firstTest, bool firstValue, double
     #endif
 }
 
+//=================================================================================
+bool ReportReducePolicies (
+    const std::shared_ptr<CKeySet> &keySet,
+    TestFunc_TSuperInt testSuperInt,
+    const TSuperInt &A,
+    const TSuperInt &B,
+    const TSuperInt &expectedResult
+) {
+    struct SPolicy
+    {
+        EReducePolicy   m_policy;
+        size_t          m_parameter;
+        const char*     m_name;
+    };
+    static const SPolicy c_policies[] =
+    {
+        { EReducePolicy::Never, 1, "Never" },
+        { EReducePolicy::Always, 1, "Always" },
+        { EReducePolicy::Threshold, 1, "Threshold x1" },
+        { EReducePolicy::Threshold, 2, "Threshold x2" },
+        { EReducePolicy::EveryNGates, 4, "Every 4 Gates" },
+        { EReducePolicy::EveryNGates, 16, "Every 16 Gates" },
+    };
+
+    // the reduced result is the same no matter which policy made it
+    TSuperInt expected(expectedResult);
+    expected.Reduce();
+
+    const EReducePolicy oldPolicy = keySet->GetReducePolicy();
+    const size_t oldParameter = keySet->GetReduceParameter();
+
+    bool success = true;
+    const SPolicy *fastest = nullptr;
+    double fastestMS = 0.0;
+    printf("Reduce Policies:\n");
+    for (const SPolicy &policy : c_policies)
+    {
+        keySet->SetReducePolicy(policy.m_policy, policy.m_parameter);
+
+        // take the best of several samples, since the operations can be very quick
+        double bestMS = 0.0;
+        for (int sample = 0; sample < REDUCE_POLICY_SAMPLES(); ++sample)
+        {
+            LARGE_INTEGER start, stop;
+            QueryPerformanceCounter(&start);
+            TSuperInt result = testSuperInt(A, B);
+            QueryPerformanceCounter(&stop);
+            double timeMS = double(stop.QuadPart - start.QuadPart) / g_PCFreq;
+            if (sample == 0 || timeMS < bestMS)
+                bestMS = timeMS;
+
+            if (sample == 0)
+            {
+                result.Reduce();
+                if (result.GetBits() != expected.GetBits())
+                {
+                    std::cout << "ERROR! " << policy.m_name << " gave a different result!\n";
+                    success = false;
+                }
+            }
+        }
+
+        printf("  %-16s %f ms\n", policy.m_name, bestMS);
+        if (fastest == nullptr || bestMS < fastestMS)
+        {
+            fastest = &policy;
+            fastestMS = bestMS;
+        }
+    }
+    printf("  Fastest: %s\n", fastest->m_name);
+
+    keySet->SetReducePolicy(oldPolicy, oldParameter);
+    return success;
+}
+
+//=================================================================================
+// operation and bit count -> backend -> time in ms
+typedef std::map<std::pair<std::string, int>, std::map<std::string, double>> TBackendPerfTable;
+
+//=================================================================================
+void LoadBackendPerfTable (TBackendPerfTable &table)
+{
+    table.clear();
+    FILE *file = fopen(BACKEND_REPORT_FILE(), "rt");
+    if (!file)
+        return;
+
+    char backend[64], opName[64];
+    int numBits;
+    double timeMS;
+    fscanf(file, "%*[^\n]\n");
+    while (fscanf(file, "%63[^,],%i,%63[^,],%lf\n", backend, &numBits, opName, &timeMS) == 4)
+        table[std::make_pair(std::string(opName), numBits)][backend] = timeMS;
+    fclose(file);
+}
+
+//=================================================================================
+void ReportBackendPerf (
+    const char* opName,
+    TestFunc_TSuperInt testSuperInt,
+    const TSuperInt &A,
+    const TSuperInt &B
+) {
+    // take the best of several samples, since the operations can be very quick
+    double bestMS = 0.0;
+    for (int sample = 0; sample < BACKEND_REPORT_SAMPLES(); ++sample)
+    {
+        LARGE_INTEGER start, stop;
+        QueryPerformanceCounter(&start);
+        TSuperInt result = testSuperInt(A, B);
+        QueryPerformanceCounter(&stop);
+        double timeMS = double(stop.QuadPart - start.QuadPart) / g_PCFreq;
+        if (sample == 0 || timeMS < bestMS)
+            bestMS = timeMS;
+    }
+    printf("Backend %s: %f ms\n", TINT_BACKEND_NAME, bestMS);
+
+    // replace any earlier time for this backend, operation and bit count
+    TBackendPerfTable table;
+    LoadBackendPerfTable(table);
+    table[std::make_pair(std::string(opName), int(TSuperInt::c_numBits))][TINT_BACKEND_NAME] = bestMS;
+
+    FILE *file = fopen(BACKEND_REPORT_FILE(), "w+t");
+    if (!file)
+        return;
+    fprintf(file, "Backend,Bits,Operation,Time MS\n");
+    for (const auto &row : table)
+    {
+        for (const auto &time : row.second)
+            fprintf(file, "%s,%i,%s,%f\n", time.first.c_str(), row.first.second, row.first.first.c_str(), time.second);
+    }
+    fclose(file);
+}
+
+//=================================================================================
+void ShowBackendPerfTable ()
+{
+    TBackendPerfTable table;
+    LoadBackendPerfTable(table);
+
+    std::vector<std::string> backends;
+    for (const auto &row : table)
+    {
+        for (const auto &time : row.second)
+        {
+            if (std::find(backends.begin(), backends.end(), time.first) == backends.end())
+                backends.push_back(time.first);
+        }
+    }
+    std::sort(backends.begin(), backends.end());
+
+    printf("\n%-20s %4s", "Operation", "Bits");
+    for (const std::string &backend : backends)
+        printf(" %14s", backend.c_str());
+    printf("  Fastest\n");
+
+    for (const auto &row : table)
+    {
+        printf("%-20s %4i", row.first.first.c_str(), row.first.second);
+        const char* fastest = nullptr;
+        double fastestMS = 0.0;
+        for (const std::string &backend : backends)
+        {
+            auto time = row.second.find(backend);
+            if (time == row.second.end())
+            {
+                printf(" %14s", "-");
+                continue;
+            }
+            printf(" %11.3f ms", time->second);
+            if (fastest == nullptr || time->second < fastestMS)
+            {
+                fastest = time->first.c_str();
+                fastestMS = time->second;
+            }
+        }
+        printf("  %s\n", fastest);
+    }
+}
+
+//=================================================================================
+// gate counts and replay times of each operation's circuit, before and after CCircuit::Optimize()
+struct SCircuitReport
+{
+    size_t  m_gates;
+    size_t  m_optimizedGates;
+    double  m_replayMS;
+    double  m_optimizedMS;
+};
+std::map<std::string, SCircuitReport> g_circuitReports;
+
+//=================================================================================
+// best time of several evaluations, since small circuits are very quick
+double TimeCircuit (const CCircuit &circuit, const std::vector<TINT> &inputs, const CKeySet &keySet, std::vector<TINT> &outputs)
+{
+    double bestMS = 0.0;
+    for (int sample = 0; sample < CIRCUIT_REPORT_SAMPLES(); ++sample)
+    {
+        LARGE_INTEGER start, stop;
+        QueryPerformanceCounter(&start);
+        circuit.Evaluate(inputs, keySet, outputs);
+        QueryPerformanceCounter(&stop);
+        double timeMS = double(stop.QuadPart - start.QuadPart) / g_PCFreq;
+        if (sample == 0 || timeMS < bestMS)
+            bestMS = timeMS;
+    }
+    return bestMS;
+}
+
+//=================================================================================
+bool RecordCircuit (
+    const char* opName,
+    const std::shared_ptr<CKeySet> &keySet,
+    TestFunc_TSuperInt testSuperInt,
+    const TSuperInt &A,
+    const TSuperInt &B,
+    const TSuperInt &expectedResult
+) {
+    // run the operation on bits that are circuit nodes instead of superpositional values
+    CCircuit circuit;
+    std::shared_ptr<CKeySet> recordKeySet = std::make_shared<CKeySet>();
+    recordKeySet->SetRecorder(&circuit);
+    std::vector<TINT> inputNodes(TSuperInt::c_numBits * 2);
+    for (TINT &node : inputNodes)
+        node = circuit.AddInput();
+    std::vector<TINT>::const_iterator inputsA = inputNodes.begin();
+    std::vector<TINT>::const_iterator inputsB = inputNodes.begin() + TSuperInt::c_numBits;
+    TSuperInt recordA(inputsA, recordKeySet);
+    TSuperInt recordB(inputsB, recordKeySet);
+    TSuperInt recordResult = testSuperInt(recordA, recordB);
+    for (const TINT &bit : recordResult.GetBits())
+        circuit.AddOutput(bit);
+
+    char circuitName[256];
+    char fileName[256];
+    char cppFileName[256];
+    sprintf(circuitName, "Circuit_%s_%i", opName, int(TSuperInt::c_numBits));
+    sprintf(fileName, "%s.txt", circuitName);
+    sprintf(cppFileName, "%s.cpp", circuitName);
+    printf("Circuit: %u XOR, %u AND, written to %s and %s\n", unsigned(circuit.GetNumGates(ECircuitNode::XOR)), unsigned(circuit.GetNumGates(ECircuitNode::AND)), fileName, cppFileName);
+    if (!circuit.Write(fileName))
+    {
+        std::cout << "ERROR! could not write " << fileName << "\n";
+        return false;
+    }
+
+    // the flat code is for these keys, and reduces values that get twice as wide as the LCM
+    if (!circuit.WriteCpp(cppFileName, circuitName, keySet->GetKeysLCMBits(), keySet->GetKeysLCMBits() * 2))
+    {
+        std::cout << "ERROR! could not write " << cppFileName << "\n";
+        return false;
+    }
+
+    // read it back and replay it with the real bits
+    CCircuit replay;
+    if (!replay.Read(fileName))
+    {
+        std::cout << "ERROR! could not read " << fileName << "\n";
+        return false;
+    }
+    std::vector<TINT> inputs(A.GetBits().begin(), A.GetBits().end());
+    inputs.insert(inputs.end(), B.GetBits().begin(), B.GetBits().end());
+    std::vector<TINT> outputs;
+    SCircuitReport report;
+    report.m_replayMS = TimeCircuit(replay, inputs, *keySet, outputs);
+    printf("Circuit Replay: %f ms\n", report.m_replayMS);
+
+    // the reduced results have to match
+    std::vector<TINT>::const_iterator outputsBegin = outputs.begin();
+    TSuperInt replayResult(outputsBegin, keySet);
+    replayResult.Reduce();
+    TSuperInt expected(expectedResult);
+    expected.Reduce();
+    if (replayResult.GetBits() != expected.GetBits())
+    {
+        std::cout << "ERROR! circuit replay gave a different result!\n";
+        return false;
+    }
+
+    // Optimize the circuit and run it again.  Optimizing can change the values (A XOR A
+    // becomes 0 instead of 2A), so the optimized outputs only have to decode the same.
+    CCircuit optimized(replay);
+    optimized.Optimize();
+    std::vector<TINT> optimizedOutputs;
+    report.m_optimizedMS = TimeCircuit(optimized, inputs, *keySet, optimizedOutputs);
+    report.m_gates = replay.GetNumGates();
+    report.m_optimizedGates = optimized.GetNumGates();
+    printf("Optimized Circuit: %u XOR, %u AND, %f ms\n", unsigned(optimized.GetNumGates(ECircuitNode::XOR)), unsigned(optimized.GetNumGates(ECircuitNode::AND)), report.m_optimizedMS);
+    g_circuitReports[opName] = report;
+
+    for (const TINT &key : keySet->GetKeys())
+    {
+        for (size_t i = 0; i < outputs.size(); ++i)
+        {
+            if ((outputs[i] % key) % 2 != (optimizedOutputs[i] % key) % 2)
+            {
+                std::cout << "ERROR! optimized circuit gave a different result for key " << key << "!\n";
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//=================================================================================
+void ShowCircuitReports ()
+{
+    printf("\n%-20s %8s %10s %8s %12s %12s %8s\n", "Operation", "Gates", "Optimized", "Saved", "Replay", "Optimized", "Saved");
+    for (const auto &row : g_circuitReports)
+    {
+        const SCircuitReport &report = row.second;
+        printf("%-20s %8u %10u %7.1f%% %9.3f ms %9.3f ms %7.1f%%\n",
+            row.first.c_str(),
+            unsigned(report.m_gates),
+            unsigned(report.m_optimizedGates),
+            report.m_gates > 0 ? 100.0 * double(report.m_gates - report.m_optimizedGates) / double(report.m_gates) : 0.0,
+            report.m_replayMS,
+            report.m_optimizedMS,
+            report.m_replayMS > 0.0 ? 100.0 * (report.m_replayMS - report.m_optimizedMS) / report.m_replayMS : 0.0
+        );
+    }
+}
+
 //=================================================================================
 bool DoTest (
     bool allowRightSideZero,
@@ -81,7 +453,9 @@ bool DoTest (
     const char* opName,
     TestFunc_TSuperInt testSuperInt,
     TestFunc_Int testInt,
-    int testIndex
+    int testIndex,
+    EReducePolicy reducePolicy,
+    size_t reduceParameter = 1
 ) {
     printf("\r\n------------------------------\r\nTesting %s (Test %i)\r\n------------------------------\r\n", opName, testIndex+1);
     bool firstTest = testIndex == 0;
@@ -126,6 +500,7 @@ bool DoTest (
     QueryPerformanceCounter(&stop);
     printf("%c %c%f ms\n", 8, 8, double(stop.QuadPart - start.QuadPart) / g_PCFreq);
     ReportPerfData(opName, firstTest, false, double(stop.QuadPart - start.QuadPart) / g_PCFreq);
+    keySet->SetReducePolicy(reducePolicy, reduceParameter);
 
     // Do the superpositional operation
     std::cout << "a " << opSymbol << " b in " << TSuperInt::c_numBits << " bits: ";
@@ -138,6 +513,23 @@ bool DoTest (
     printf("%f ms\n", double(stop.QuadPart - start.QuadPart) / g_PCFreq);
     ReportPerfData(opName, firstTest, false, double(stop.QuadPart - start.QuadPart) / g_PCFreq);
 
+    // time this backend for the backend comparison table if we should
+    #if DO_BACKEND_REPORT()
+        ReportBackendPerf(opName, testSuperInt, A, B);
+    #endif
+
+    // record the operation as a circuit and check a replay of it if we should
+    #if RECORD_CIRCUITS()
+        if (!RecordCircuit(opName, keySet, testSuperInt, A, B, resultsAB))
+            return false;
+    #endif
+
+    // compare reduce policies if we should
+    #if DO_REDUCE_POLICY_REPORT()
+        if (!ReportReducePolicies(keySet, testSuperInt, A, B, resultsAB))
+            return false;
+    #endif
+
     // report specific bit values and error levels if we should
     #if SHOW_BITS_AND_ERROR()
         ReportBitsAndError(resultsAB);
@@ -193,7 +585,9 @@ bool DoTestANF (
     const char* opSymbol,
     const char* opName,
     TestFunc_Size_T testSizeT,
-    int testIndex
+    int testIndex,
+    EReducePolicy reducePolicy,
+    size_t reduceParameter = 1
 ) {
 
     static const size_t c_numInputBits = TSuperInt::c_numBits * 2;
@@ -213,8 +607,21 @@ bool DoTestANF (
             return 0;
     };
 
-    // make ANF terms for the function passed in
-    auto terms = MakeANFTerms<c_numInputBits, c_numOutputBits>(lambda);
+    // make ANF terms for the function passed in.  Inputs with b == 0 aren't tested if
+    // allowRightSideZero is false, so their outputs can be anything.
+    #if ANF_DONT_CARES()
+        auto dontCare = [allowRightSideZero](size_t inputValue, size_t numInputBits) -> bool {
+            return !allowRightSideZero && (inputValue >> (numInputBits / 2)) == 0;
+        };
+        SANFDontCareReport dontCareReport;
+        auto terms = MakeANFTerms<c_numInputBits, c_numOutputBits>(lambda, dontCare, ANF_BALANCED_MONOMIALS() != 0, ANF_DONT_CARE_SEARCH_MS(), &dontCareReport);
+    #else
+        auto terms = MakeANFTerms<c_numInputBits, c_numOutputBits>(lambda);
+    #endif
+
+    // find the monomials the terms share, to only AND each of them together once
+    SANFMonomialLattice lattice;
+    MakeANFMonomialLattice<c_numInputBits, c_numOutputBits>(terms, ANF_MAX_MONOMIALS(), ANF_BALANCED_MONOMIALS() != 0, lattice);
 
     // make int function for the tests
     auto anfTestInt = [&terms] (const int& A, const int& B) -> int {
@@ -263,7 +670,7 @@ bool DoTestANF (
     };
 
     // make super int function for the tests
-    auto anfTestSuperInt = [&terms](const TSuperInt& a, const TSuperInt& b) -> TSuperInt {
+    auto anfTestSuperInt = [&lattice](const TSuperInt& a, const TSuperInt& b) -> TSuperInt {
 
         const std::shared_ptr<CKeySet>& keySetPointer = a.GetKeySet();
         const CKeySet& keySet = *keySetPointer;
@@ -277,72 +684,263 @@ bool DoTestANF (
             inputValue.GetBits()[i + c_numInputBits / 2] = b.GetBits()[i];
 
         TSuperInt ret(a.GetKeySet());
-        for (size_t outputBitIndex = 0; outputBitIndex < c_numOutputBits; ++outputBitIndex)
-        {
-            const std::vector<size_t>& bitTerms = terms[outputBitIndex];
-            TINT &xorSum = ret.GetBit(outputBitIndex);
-            xorSum = 0;
+        EvaluateANF(lattice, inputValue.GetBits().data(), c_numInputBits, keySet, ret.GetBits().data(), MULTITHREAD_ANF() ? ANF_THREADS() : 1, ANF_TERMS_PER_CHUNK());
+        return ret;
+    };
 
-            for (size_t termIndex = 0; termIndex < bitTerms.size(); ++termIndex)
+    // run the tests
+    bool success = DoTest(allowRightSideZero, opSymbol, opName, anfTestSuperInt, anfTestInt, testIndex, reducePolicy, reduceParameter);
+
+    // The timings are single threaded unless MULTITHREAD_ANF() is on, so check here that
+    // evaluating with ANF_THREADS() threads gives exactly the same integers as one thread,
+    // for both reduce policies that EvaluateANF() multithreads.  A chunk size of 1 makes
+    // sure chunk sums get XORed together even when there are few terms.  The key size
+    // doesn't matter for this, so small keys are used.
+    {
+        std::shared_ptr<CKeySet> keySet = std::make_shared<CKeySet>();
+        keySet->Calculate(int(c_numInputBits), 2);
+        const TINT* inputBits = keySet->GetSuperPositionedBits().data();
+        static const EReducePolicy c_policies[] = { EReducePolicy::Never, EReducePolicy::Always };
+        const size_t c_termsPerChunk[] = { ANF_TERMS_PER_CHUNK(), 1 };
+        for (EReducePolicy policy : c_policies)
+        {
+            keySet->SetReducePolicy(policy);
+            std::array<TINT, c_numOutputBits> serialBits;
+            EvaluateANF(lattice, inputBits, c_numInputBits, *keySet, serialBits.data(), 1, ANF_TERMS_PER_CHUNK());
+            for (size_t termsPerChunk : c_termsPerChunk)
             {
-                size_t term = bitTerms[termIndex];
-                if (term == 0)
+                std::array<TINT, c_numOutputBits> parallelBits;
+                EvaluateANF(lattice, inputBits, c_numInputBits, *keySet, parallelBits.data(), ANF_THREADS(), termsPerChunk);
+                if (serialBits != parallelBits)
                 {
-                    XOREQ(xorSum, 1, keySet);
-                }
-                else
-                {
-                    TINT andProduct = 1;
-
-                    for (size_t bitIndex = 0; bitIndex < c_numInputBits; ++bitIndex)
-                    {
-                        const size_t bitMask = 1 << bitIndex;
-                        if ((term & bitMask) != 0)
-                            ANDEQ(andProduct, inputValue.GetBit(bitIndex), keySet);
-                    }
-                    XOREQ(xorSum, andProduct, keySet);
+                    printf("ERROR! multithreaded ANF evaluation (reduce policy %s, %u terms per chunk) is different from single threaded!\n",
+                        policy == EReducePolicy::Never ? "Never" : "Always", unsigned(termsPerChunk));
+                    success = false;
                 }
             }
         }
+    }
 
-        return ret;
-    };
+    // report how many ANDs the monomial lattice saved
+    printf("ANF ANDs: %u, %u without sharing monomials\n", unsigned(lattice.m_numANDs), unsigned(lattice.m_numANDsWithoutLattice));
 
-    // run the tests
-    return DoTest(allowRightSideZero, opSymbol, opName, anfTestSuperInt, anfTestInt, testIndex);
+    // report how many terms and shared monomials the don't cares saved
+    #if ANF_DONT_CARES()
+        if (!allowRightSideZero)
+        {
+            const SANFCost& cost = dontCareReport.m_withDontCares;
+            const SANFCost& costWithoutDontCares = dontCareReport.m_withoutDontCares;
+            printf("ANF terms: %u, %u without don't cares\n", unsigned(cost.m_numTerms), unsigned(costWithoutDontCares.m_numTerms));
+            printf("ANF XORs + shared ANDs: %u, %u without don't cares\n", unsigned(cost.GetTotal()), unsigned(costWithoutDontCares.GetTotal()));
+        }
+    #endif
+    return success;
+}
+
+//=================================================================================
+// Runs one of a CLUTCircuit's circuits on a key set made for that circuit, and verifies it
+template <size_t NUM_INPUTS, size_t INPUT_BITS, size_t OUTPUT_BITS>
+bool DoTestLUTCircuit (
+    const char* opName,
+    const CLUTCircuit<NUM_INPUTS, INPUT_BITS, OUTPUT_BITS>& lut,
+    ELUTCircuit circuit,
+    const char* circuitName
+) {
+    typedef CLUTCircuit<NUM_INPUTS, INPUT_BITS, OUTPUT_BITS> TLUTCircuit;
+
+    LARGE_INTEGER start, stop;
+
+    // make the key set that the circuit needs
+    printf("\nMaking Keys for %s: ", circuitName);
+    std::shared_ptr<CKeySet> keySet = std::make_shared<CKeySet>();
+    QueryPerformanceCounter(&start);
+    keySet->Calculate(int(TLUTCircuit::c_numInputBits), lut.GetCost(circuit).m_minKey);
+    QueryPerformanceCounter(&stop);
+    printf("%f ms\n", double(stop.QuadPart - start.QuadPart) / g_PCFreq);
+    keySet->SetReducePolicy(TLUTCircuit::GetReducePolicy(circuit));
+
+    // Do the superpositional operation
+    std::vector<typename TLUTCircuit::TInput> inputs;
+    for (size_t i = 0; i < NUM_INPUTS; ++i)
+    {
+        std::vector<TINT>::const_iterator inputBits = keySet->GetSuperPositionedBits().begin() + i * INPUT_BITS;
+        inputs.push_back(typename TLUTCircuit::TInput(inputBits, keySet));
+    }
+    printf("%s (%s) in %u bits: ", opName, circuitName, unsigned(INPUT_BITS));
+    QueryPerformanceCounter(&start);
+    typename TLUTCircuit::TOutput result = lut.Evaluate(circuit, inputs);
+    QueryPerformanceCounter(&stop);
+    printf("%f ms\n", double(stop.QuadPart - start.QuadPart) / g_PCFreq);
+
+    // Verify results.  Each key is for the input values that its index is made of.
+    printf("Result Verification: ");
+    QueryPerformanceCounter(&start);
+    result.Reduce();
+    bool success = true;
+    const std::vector<TINT>& keys = keySet->GetKeys();
+    for (size_t keyIndex = 0; keyIndex < keys.size() && success; ++keyIndex)
+    {
+        const typename TLUTCircuit::TValues values = TLUTCircuit::ValuesFromIndex(keyIndex);
+        if (lut.IsDontCare(values))
+            continue;
+
+        const size_t actualResult = lut.Lookup(values);
+        const size_t computedResult = result.DecodeBinary(keys[keyIndex]);
+        if (computedResult != actualResult)
+        {
+            std::cout << "  [" << keyIndex << "] (" << keys[keyIndex] << ")  = " << computedResult << " (actually " << actualResult << ")\n";
+            std::cout << "ERROR! incorrect value detected!\n";
+            success = false;
+        }
+    }
+    QueryPerformanceCounter(&stop);
+    printf("%f ms\n", double(stop.QuadPart - start.QuadPart) / g_PCFreq);
+
+    // report circuit complexity
+    printf("Circuit Complexity: %0.3f\n", keySet->GetComplexityIndex());
+
+    // return false if the value verification failed
+    return success;
+}
+
+//=================================================================================
+template <size_t NUM_INPUTS, size_t INPUT_BITS, size_t OUTPUT_BITS>
+bool DoTestLUT (
+    const char* opName,
+    CLUTCircuit<NUM_INPUTS, INPUT_BITS, OUTPUT_BITS>& lut,
+    int testIndex
+) {
+    typedef CLUTCircuit<NUM_INPUTS, INPUT_BITS, OUTPUT_BITS> TLUTCircuit;
+
+    printf("\r\n------------------------------\r\nTesting %s (Test %i)\r\n------------------------------\r\n", opName, testIndex+1);
+    lut.SetANFThreads(MULTITHREAD_ANF() ? ANF_THREADS() : 1, ANF_TERMS_PER_CHUNK());
+
+    // report what each circuit is predicted to cost, and which one will be used
+    static const char* c_circuitNames[] = { "ANF", "Gates" };
+    for (size_t circuitIndex = 0; circuitIndex < size_t(ELUTCircuit::Count); ++circuitIndex)
+    {
+        const typename TLUTCircuit::SCost& cost = lut.GetCost(ELUTCircuit(circuitIndex));
+        if (cost.m_exists)
+            printf("%-6s %u XOR, %u AND, %u bit LCM, predicted cost %0.0f\n", c_circuitNames[circuitIndex], unsigned(cost.m_numXORs), unsigned(cost.m_numANDs), unsigned(cost.m_keysLCMBits), cost.m_cost);
+        else
+            printf("%-6s none\n", c_circuitNames[circuitIndex]);
+    }
+    printf("Using %s\n", c_circuitNames[size_t(lut.GetCircuit())]);
+
+    // test every circuit, not just the one Evaluate() uses, each with its own min key and
+    // reduce policy
+    bool success = true;
+    for (size_t circuitIndex = 0; circuitIndex < size_t(ELUTCircuit::Count); ++circuitIndex)
+    {
+        if (lut.GetCost(ELUTCircuit(circuitIndex)).m_exists)
+            success &= DoTestLUTCircuit(opName, lut, ELUTCircuit(circuitIndex), c_circuitNames[circuitIndex]);
+    }
+    return success;
+}
+
+//=================================================================================
+// Lets CLUTCircuit choose between the gate circuit and the ANF circuit for an operation
+bool DoTestLUTOperation (
+    bool allowRightSideZero,
+    const char* opName,
+    TestFunc_TSuperInt testSuperInt,
+    TestFunc_Int testInt,
+    int testIndex
+) {
+    typedef CLUTCircuit<2, TSuperInt::c_numBits> TLUTCircuit;
+    TLUTCircuit lut(
+        [testInt, allowRightSideZero] (const TLUTCircuit::TValues& inputs) -> size_t {
+            if (!allowRightSideZero && inputs[1] == 0)
+                return 0;
+            return TSuperInt::BinaryFromInt(testInt(TSuperInt::IntFromBinary(inputs[0]), TSuperInt::IntFromBinary(inputs[1])));
+        },
+        [testSuperInt] (const std::vector<TSuperInt>& inputs) -> TSuperInt {
+            return testSuperInt(inputs[0], inputs[1]);
+        },
+        [allowRightSideZero] (const TLUTCircuit::TValues& inputs) -> bool {
+            return !allowRightSideZero && inputs[1] == 0;
+        },
+        ANF_DONT_CARES() ? ANF_DONT_CARE_SEARCH_MS() : 0.0,
+        ANF_MAX_MONOMIALS(),
+        ANF_BALANCED_MONOMIALS() != 0
+    );
+    return DoTestLUT(opName, lut, testIndex);
+}
+
+//=================================================================================
+// a * b + c, to test a CLUTCircuit with more than two inputs
+bool DoTestLUTFusedMultiplyAdd (int testIndex)
+{
+    typedef CSuperInt<2> TFMAInt;
+    typedef CLUTCircuit<3, 2> TLUTCircuit;
+    TLUTCircuit lut(
+        [] (const TLUTCircuit::TValues& inputs) -> size_t {
+            return TFMAInt::BinaryFromInt(TFMAInt::IntFromBinary(inputs[0]) * TFMAInt::IntFromBinary(inputs[1]) + TFMAInt::IntFromBinary(inputs[2]));
+        },
+        [] (const std::vector<TFMAInt>& inputs) -> TFMAInt {
+            return inputs[0] * inputs[1] + inputs[2];
+        },
+        TLUTCircuit::TDontCareFunction(),
+        0.0,
+        ANF_MAX_MONOMIALS(),
+        ANF_BALANCED_MONOMIALS() != 0
+    );
+    return DoTestLUT("LUT_FusedMultiplyAdd", lut, testIndex);
 }
 
 //=================================================================================
 bool DoTests (int testIndex)
 {
-    if (!DoTest(true, "+", "Addition", DoAddition<TSuperInt>, DoAddition<int>, testIndex))
+    // Gate based circuits build up large values and are much faster when reduced after every
+    // gate.  The ANF circuits are shallow and are faster without reducing.  Turn on
+    // DO_REDUCE_POLICY_REPORT() to compare policies.
+    if (!DoTest(true, "+", "Addition", DoAddition<TSuperInt>, DoAddition<int>, testIndex, EReducePolicy::Always))
+        return false;
+
+    if (!DoTest(true, "-", "Subtraction", DoSubtraction<TSuperInt>, DoSubtraction<int>, testIndex, EReducePolicy::Always))
         return false;
 
-    if (!DoTest(true, "-", "Subtraction", DoSubtraction<TSuperInt>, DoSubtraction<int>, testIndex))
+    if (!DoTest(true, "*", "Multiplication", DoMultiplication<TSuperInt>, DoMultiplication<int>, testIndex, EReducePolicy::Always))
         return false;
 
-    if (!DoTest(true, "*", "Multiplication", DoMultiplication<TSuperInt>, DoMultiplication<int>, testIndex))
+    if (!DoTest(false, "/", "Division", DoDivision<TSuperInt>, DoDivision<int>, testIndex, EReducePolicy::Always))
         return false;
 
-    if (!DoTest(false, "/", "Division", DoDivision<TSuperInt>, DoDivision<int>, testIndex))
+    if (!DoTest(false, "%", "Modulus", DoModulus<TSuperInt>, DoModulus<int>, testIndex, EReducePolicy::Always))
         return false;
 
-    if (!DoTest(false, "%", "Modulus", DoModulus<TSuperInt>, DoModulus<int>, testIndex))
+    if (!DoTestANF(true, "+", "ANF_Addition", DoAddition<size_t>, testIndex, EReducePolicy::Never))
         return false;
 
-    if (!DoTestANF(true, "+", "ANF_Addition", DoAddition<size_t>, testIndex))
+    if (!DoTestANF(true, "-", "ANF_Subtraction", DoSubtraction<size_t>, testIndex, EReducePolicy::Never))
         return false;
 
-    if (!DoTestANF(true, "-", "ANF_Subtraction", DoSubtraction<size_t>, testIndex))
+    if (!DoTestANF(true, "/", "ANF_Multiplication", DoMultiplication<size_t>, testIndex, EReducePolicy::Never))
         return false;
 
-    if (!DoTestANF(true, "/", "ANF_Multiplication", DoMultiplication<size_t>, testIndex))
+    if (!DoTestANF(false, "/", "ANF_Division", DoDivision<size_t>, testIndex, EReducePolicy::Never))
         return false;
 
-    if (!DoTestANF(false, "/", "ANF_Division", DoDivision<size_t>, testIndex))
+    if (!DoTestANF(false, "%", "ANF_Modulus", DoModulus<size_t>, testIndex, EReducePolicy::Never))
         return false;
 
-    if (!DoTestANF(false, "%", "ANF_Modulus", DoModulus<size_t>, testIndex))
+    // CLUTCircuit picks the gate or ANF circuit for these, whichever is predicted to be cheaper
+    if (!DoTestLUTOperation(true, "LUT_Addition", DoAddition<TSuperInt>, DoAddition<int>, testIndex))
+        return false;
+
+    if (!DoTestLUTOperation(true, "LUT_Subtraction", DoSubtraction<TSuperInt>, DoSubtraction<int>, testIndex))
+        return false;
+
+    if (!DoTestLUTOperation(true, "LUT_Multiplication", DoMultiplication<TSuperInt>, DoMultiplication<int>, testIndex))
+        return false;
+
+    if (!DoTestLUTOperation(false, "LUT_Division", DoDivision<TSuperInt>, DoDivision<int>, testIndex))
+        return false;
+
+    if (!DoTestLUTOperation(false, "LUT_Modulus", DoModulus<TSuperInt>, DoModulus<int>, testIndex))
+        return false;
+
+    if (!DoTestLUTFusedMultiplyAdd(testIndex))
         return false;
 
     return true;
@@ -367,6 +965,13 @@ int main (int argc, char **argv)
     {
         success &= DoTests(i);
     }
+    #if DO_BACKEND_REPORT()
+        ShowBackendPerfTable();
+    #endif
+
+    #if RECORD_CIRCUITS()
+        ShowCircuitReports();
+    #endif
     WaitForEnter();
     return success ? 0 : 1;
 }
@@ -374,8 +979,6 @@ int main (int argc, char **argv)
 /*
 
 TODO:
-* make it so the anf circuits don't reduce, but the others do?
-
 ? does reducevalue help or hurt? might make no diff in anf
  * test and see if it changes anything in anf. if not, drop it? even though it might help the other case? how to measure that.
  * need to change note in paper if it makes no difference.
@@ -389,6 +992,8 @@ TODO:
  * To simplify the paper, maybe focus on ANF execution times?
 
 * Maybe need to find another metric for circuit complexity.  sum of keys doesn't seem to be appropriate as it doesn't tie to execution time.
+ * CLUTCircuit predicts cost from XOR / AND counts and operand sizes in limbs, to choose between ANF and gates.
+  * it always picks ANF for the ops in DoTests.  See how well the predicted costs line up with timings at more bits.
 
 * run sleepy on this code to see where time is being spent.
  * 5 bit division totally runs fast in ANF so seems like copying / allocating might be the issue?
@@ -400,6 +1005,7 @@ TODO:
  * maybe multithread this and use it for timings?
  * maybe option to multithread? not sure if it's exactly honest to report it as the main timing.
   * maybe report timing per output bit, so could see how it would multithread? i dunno
+ * ANF circuits can be multithreaded now, see MULTITHREAD_ANF().  It's off by default so the timings stay single threaded.
 
 Paper:
 
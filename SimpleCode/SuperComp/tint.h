@@ -10,13 +10,36 @@
 
 // defines the 
 
-#include <boost/multiprecision/cpp_int.hpp>
-//#include <boost/multiprecision/tommath.hpp>
-//#include <boost/multiprecision/gmp.hpp>
+// The library TINT comes from.  Change the default here, or define TINT_BACKEND in the
+// compiler's preprocessor definitions.  GMP and libtommath need their libraries linked
+// in (MPIR provides gmp.h on windows).
+#define TINT_BACKEND_CPP_INT    0
+#define TINT_BACKEND_GMP        1
+#define TINT_BACKEND_TOMMATH    2
+
+#ifndef TINT_BACKEND
+#define TINT_BACKEND TINT_BACKEND_CPP_INT
+#endif
 
-//typedef int64_t TINT;
-//typedef boost::multiprecision::int128_t TINT;
-//typedef boost::multiprecision::gmp_int TINT;
-//typedef boost::multiprecision::tom_int TINT;
-typedef boost::multiprecision::cpp_int TINT;
+#include <boost/multiprecision/cpp_int.hpp>
 
+#if TINT_BACKEND == TINT_BACKEND_GMP
+    #include <boost/multiprecision/gmp.hpp>
+    #ifdef _MSC_VER
+        #pragma comment(lib, "mpir.lib")
+    #endif
+    typedef boost::multiprecision::mpz_int TINT;
+    #define TINT_BACKEND_NAME "gmp"
+#elif TINT_BACKEND == TINT_BACKEND_TOMMATH
+    #include <boost/multiprecision/tommath.hpp>
+    #ifdef _MSC_VER
+        #pragma comment(lib, "tommath.lib")
+    #endif
+    typedef boost::multiprecision::tom_int TINT;
+    #define TINT_BACKEND_NAME "tommath"
+#else
+    //typedef int64_t TINT;
+    //typedef boost::multiprecision::int128_t TINT;
+    typedef boost::multiprecision::cpp_int TINT;
+    #define TINT_BACKEND_NAME "cpp_int"
+#endif